@@ -37,7 +37,7 @@ public:
                 rec.normal = vec3((a==0), (a==1), (a==2));
         }
         rec.set_face_normal(r, rec.normal);
-        rec.mat = mat_ptr;
+        rec.mat = mat_ptr.get();
         return true;
     }
 private:
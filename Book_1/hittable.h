@@ -7,7 +7,7 @@ class hit_record {
   public:
     point3 p;
     vec3 normal;
-    std::shared_ptr<material> mat;
+    material* mat;  // Non-owning; the hittable that set it keeps the material alive
     double t;
 
     bool front_face;
@@ -34,7 +34,7 @@ public:
         rec.p = r.at(t);
         rec.normal = unit_vector(cross(edge1, edge2));
         rec.set_face_normal(r, rec.normal);
-        rec.mat = mat_ptr;
+        rec.mat = mat_ptr.get();
         return true;
     }
 private:
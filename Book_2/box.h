@@ -1,48 +1,90 @@
-
 #ifndef BOX_H
 #define BOX_H
 
 #include "hittable.h"
-#include "vec3.h"
-#include "material.h"
-#include <algorithm>
+#include "aabb.h"
+#include <cmath>
 #include <memory>
 
 
 class box : public hittable {
-public:
-    box(const point3& min_corner, const point3& max_corner, std::shared_ptr<material> mat)
-        : min_corner(min_corner), max_corner(max_corner), mat_ptr(mat) {}
-
-    virtual ~box() = default;
+  public:
+    box(const point3& a, const point3& b, std::shared_ptr<material> mat) : mat(mat) {
+        // The box spans the two opposite vertices a & b, in any coordinate order.
+        min_corner = point3(std::fmin(a.x(),b.x()), std::fmin(a.y(),b.y()), std::fmin(a.z(),b.z()));
+        max_corner = point3(std::fmax(a.x(),b.x()), std::fmax(a.y(),b.y()), std::fmax(a.z(),b.z()));
+        bbox = aabb(min_corner, max_corner);
+    }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        double tmin = ray_t.min, tmax = ray_t.max;
-        for (int a = 0; a < 3; a++) {
-            double invD = 1.0 / r.direction()[a];
-            double t0 = (min_corner[a] - r.origin()[a]) * invD;
-            double t1 = (max_corner[a] - r.origin()[a]) * invD;
-            if (invD < 0.0) std::swap(t0, t1);
-            tmin = t0 > tmin ? t0 : tmin;
-            tmax = t1 < tmax ? t1 : tmax;
-            if (tmax <= tmin) return false;
-        }
-        rec.t = tmin;
-        rec.p = r.at(rec.t);
-        // Simple normal calculation (not robust for corners/edges)
-        for (int a = 0; a < 3; a++) {
-            if (std::abs(rec.p[a] - min_corner[a]) < 1e-4)
-                rec.normal = -vec3((a==0), (a==1), (a==2));
-            if (std::abs(rec.p[a] - max_corner[a]) < 1e-4)
-                rec.normal = vec3((a==0), (a==1), (a==2));
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        // Slab test, keeping track of which axis bounds the entry and exit distances.
+        auto t_near = -infinity, t_far = infinity;
+        int near_axis = 0, far_axis = 0;
+
+        for (int axis = 0; axis < 3; axis++) {
+            auto adinv = 1.0 / r.direction()[axis];
+            auto t0 = (min_corner[axis] - r.origin()[axis]) * adinv;
+            auto t1 = (max_corner[axis] - r.origin()[axis]) * adinv;
+            if (adinv < 0) std::swap(t0, t1);
+
+            if (t0 > t_near) { t_near = t0; near_axis = axis; }
+            if (t1 < t_far)  { t_far  = t1; far_axis  = axis; }
         }
-        rec.set_face_normal(r, rec.normal);
-        rec.mat = mat_ptr;
+
+        if (t_near > t_far)
+            return false;
+
+        // Use the entry face, or the exit face when the ray starts inside the box.
+        bool entering = ray_t.surrounds(t_near);
+        if (!entering && !ray_t.surrounds(t_far))
+            return false;
+
+        auto axis = entering ? near_axis : far_axis;
+        rec.t = entering ? t_near : t_far;
+        rec.object = this;
+
+        // The outward normal points against the ray on entry and along it on exit.
+        bool positive_face = (r.direction()[axis] > 0) != entering;
+        rec.prim = std::uint32_t(2*axis + (positive_face ? 1 : 0));
+
         return true;
     }
-private:
+
+    void set_surface(const ray& r, hit_record& rec) const override {
+        int axis = int(rec.prim / 2);
+        rec.p = r.at(rec.t);
+
+        vec3 outward_normal(0,0,0);
+        outward_normal[axis] = (rec.prim % 2) ? 1 : -1;
+        rec.set_face_normal(r, outward_normal);
+
+        // Face coordinates follow the two remaining axes, each mapped to [0,1].
+        auto a1 = (axis + 1) % 3;
+        auto a2 = (axis + 2) % 3;
+        rec.u = (rec.p[a1] - min_corner[a1]) / (max_corner[a1] - min_corner[a1]);
+        rec.v = (rec.p[a2] - min_corner[a2]) / (max_corner[a2] - min_corner[a2]);
+        rec.mat = mat.get();
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const override
+    {
+        // Only translations keep the box axis-aligned; rotated boxes stay behind a wrapper.
+        if (xf.is_identity() || !xf.is_translation())
+            return nullptr;
+        return std::make_shared<box>(min_corner + xf.offset, max_corner + xf.offset, mat);
+    }
+
+  private:
     point3 min_corner, max_corner;
-    std::shared_ptr<material> mat_ptr;
+    std::shared_ptr<material> mat;
+    aabb bbox;
 };
 
 #endif
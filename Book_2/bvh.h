@@ -46,17 +46,43 @@ class bvh_node : public hittable {
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
         if (!bbox.hit(r, ray_t))
             return false;
 
-        bool hit_left = left->hit(r, ray_t, rec);
-        bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+        bool hit_left = left->intersect(r, ray_t, rec);
+        bool hit_right = right->intersect(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
 
         return hit_left || hit_right;
     }
 
     aabb bounding_box() const override { return bbox; }
 
+    std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const override
+    {
+        // Keeps the tree topology and refits the bounds around the baked children.
+        auto new_left = left->transformed(xf, counts);
+        auto new_right = (right == left) ? new_left : right->transformed(xf, counts);
+        if (!new_left && !new_right && xf.is_identity())
+            return nullptr;
+
+        std::vector<std::shared_ptr<hittable>> children = {
+            new_left ? new_left : xf.wrap(left),
+            new_right ? new_right : xf.wrap(right)
+        };
+        return std::make_shared<bvh_node>(children, 0, (right == left) ? 1 : 2);
+    }
+
+    void count_instances(instance_counts& counts) const override {
+        left->count_instances(counts);
+        if (right != left)
+            right->count_instances(counts);
+    }
+
   private:
     std::shared_ptr<hittable> left;
     std::shared_ptr<hittable> right;
@@ -0,0 +1,183 @@
+#ifndef COMPRESSED_BVH_H
+#define COMPRESSED_BVH_H
+
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "ray.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+
+// Flattened BVH whose child bounds are stored as 8- or 16-bit offsets inside the parent's box.
+// The whole tree lives in one contiguous node array; only the root box is kept in full
+// precision and every other box is decoded on the fly during traversal.
+template <typename quant_t>
+class compressed_bvh : public hittable {
+  public:
+    compressed_bvh(const std::vector<std::shared_ptr<hittable>>& objects)
+      : primitives(objects)
+    {
+        bbox = range_box(0, primitives.size());
+
+        if (primitives.empty())
+            return;
+
+        nodes.reserve(primitives.size());
+        root = build(0, primitives.size(), bbox);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (primitives.empty() || !bbox.hit(r, ray_t))
+            return false;
+
+        // Median splits keep the tree depth logarithmic, so a small fixed stack is enough.
+        struct stack_entry {
+            std::uint32_t ref;
+            aabb frame;
+        };
+        stack_entry stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = { root, bbox };
+
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+
+        while (stack_size > 0) {
+            const auto entry = stack[--stack_size];
+
+            if (is_leaf(entry.ref)) {
+                const auto& object = primitives[leaf_index(entry.ref)];
+                if (object->intersect(r, interval(ray_t.min, closest_so_far), rec)) {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+                continue;
+            }
+
+            const auto& n = nodes[entry.ref];
+            for (int c = 1; c >= 0; c--) {
+                auto child_box = dequantize(n.lo[c], n.hi[c], entry.frame);
+                if (child_box.hit(r, interval(ray_t.min, closest_so_far)))
+                    stack[stack_size++] = { n.child[c], child_box };
+            }
+        }
+
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t node_memory() const {
+        // Returns the number of bytes used by the flattened node array.
+        return nodes.size() * sizeof(node);
+    }
+
+  private:
+    struct node {
+        quant_t lo[2][3];          // Quantized child minimums, relative to this node's box
+        quant_t hi[2][3];          // Quantized child maximums, relative to this node's box
+        std::uint32_t child[2];    // Node index, or primitive index tagged with leaf_flag
+    };
+
+    static constexpr std::uint32_t leaf_flag = 0x80000000u;
+    static constexpr double levels = double(std::numeric_limits<quant_t>::max());
+
+    std::vector<std::shared_ptr<hittable>> primitives;
+    std::vector<node> nodes;
+    std::uint32_t root = 0;
+    aabb bbox;
+
+    static bool is_leaf(std::uint32_t ref) { return (ref & leaf_flag) != 0; }
+    static std::uint32_t leaf_index(std::uint32_t ref) { return ref & ~leaf_flag; }
+
+    aabb range_box(size_t start, size_t end) const {
+        auto box = aabb::empty;
+        for (size_t object_index = start; object_index < end; object_index++)
+            box = aabb(box, primitives[object_index]->bounding_box());
+        return box;
+    }
+
+    std::uint32_t build(size_t start, size_t end, const aabb& frame) {
+        // Builds the subtree for the span of primitives, whose bounds have already been
+        // quantized by the parent into `frame`. Children are encoded relative to that same
+        // decoded frame, so traversal reproduces exactly the boxes computed here.
+
+        size_t object_span = end - start;
+
+        if (object_span == 1)
+            return std::uint32_t(start) | leaf_flag;
+
+        int axis = range_box(start, end).longest_axis();
+        std::sort(std::begin(primitives) + start, std::begin(primitives) + end,
+            [axis](const std::shared_ptr<hittable>& a, const std::shared_ptr<hittable>& b) {
+                return a->bounding_box().axis_interval(axis).min
+                     < b->bounding_box().axis_interval(axis).min;
+            });
+
+        auto mid = start + object_span/2;
+
+        node n;
+        quantize(range_box(start, mid), frame, n.lo[0], n.hi[0]);
+        quantize(range_box(mid, end),   frame, n.lo[1], n.hi[1]);
+
+        auto node_index = std::uint32_t(nodes.size());
+        nodes.push_back(n);
+
+        // Recursion grows `nodes`, so write the children back through the index.
+        auto left  = build(start, mid, dequantize(n.lo[0], n.hi[0], frame));
+        auto right = build(mid, end,   dequantize(n.lo[1], n.hi[1], frame));
+        nodes[node_index].child[0] = left;
+        nodes[node_index].child[1] = right;
+
+        return node_index;
+    }
+
+    static double decode(const interval& f, quant_t q) {
+        if (q == quant_t(levels)) return f.max;
+        return f.min + q * (f.size() / levels);
+    }
+
+    static void quantize(const aabb& box, const aabb& frame, quant_t lo[3], quant_t hi[3]) {
+        // Conservatively rounds the box outwards to the quantization grid of `frame`.
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& f = frame.axis_interval(axis);
+            const interval& b = box.axis_interval(axis);
+            auto scale = levels / f.size();
+
+            auto qlo = std::clamp(std::floor((b.min - f.min) * scale), 0.0, levels);
+            auto qhi = std::clamp(std::ceil ((b.max - f.min) * scale), 0.0, levels);
+            lo[axis] = quant_t(qlo);
+            hi[axis] = quant_t(qhi);
+
+            // Floating-point error in decode() must never shrink the box.
+            while (lo[axis] > 0 && decode(f, lo[axis]) > b.min) lo[axis]--;
+            while (hi[axis] < quant_t(levels) && decode(f, hi[axis]) < b.max) hi[axis]++;
+        }
+    }
+
+    static aabb dequantize(const quant_t lo[3], const quant_t hi[3], const aabb& frame) {
+        return aabb(
+            interval(decode(frame.x, lo[0]), decode(frame.x, hi[0])),
+            interval(decode(frame.y, lo[1]), decode(frame.y, hi[1])),
+            interval(decode(frame.z, lo[2]), decode(frame.z, hi[2]))
+        );
+    }
+};
+
+// 20-byte nodes: the smallest footprint, at the cost of looser child boxes.
+using compressed_bvh8  = compressed_bvh<std::uint8_t>;
+
+// 32-byte nodes: boxes within 1/65535 of the parent extent.
+using compressed_bvh16 = compressed_bvh<std::uint16_t>;
+
+#endif
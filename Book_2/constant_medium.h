@@ -47,13 +47,15 @@ class constant_medium : public hittable {
 
         rec.normal = vec3(1,0,0);  // arbitrary
         rec.front_face = true;     // also arbitrary
-        rec.mat = phase_function;
+        rec.mat = phase_function.get();
 
         return true;
     }
 
     aabb bounding_box() const override { return boundary->bounding_box(); }
 
+    aabb bounding_box_at(double time) const override { return boundary->bounding_box_at(time); }
+
   private:
     std::shared_ptr<hittable> boundary;
     double neg_inv_density;
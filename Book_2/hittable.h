@@ -2,20 +2,76 @@
 #define HITTABLE_H
 
 #include "aabb.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
 
 class material;
+class hittable;
+
+// Number of transform wrappers referring to each object, used to tell shared instances apart
+// from objects placed only once when baking transforms.
+using instance_counts = std::unordered_map<const hittable*, int>;
+
+class rigid_transform
+{
+    // Rotation about the y axis followed by a translation, which is what any chain of
+    // `translate` and `rotate_y` wrappers amounts to.
+public:
+    double angle;   // Degrees
+    vec3 offset;
+
+    rigid_transform() : rigid_transform(0, vec3(0,0,0)) {}
+
+    rigid_transform(double angle, const vec3& offset) : angle(angle), offset(offset) {
+        auto radians = degrees_to_radians(angle);
+        sin_theta = std::sin(radians);
+        cos_theta = std::cos(radians);
+    }
+
+    bool is_identity() const { return angle == 0 && offset.length_squared() == 0; }
+    bool is_translation() const { return angle == 0; }
+
+    vec3 vector(const vec3& v) const {
+        return vec3(cos_theta*v.x() + sin_theta*v.z(), v.y(), -sin_theta*v.x() + cos_theta*v.z());
+    }
+
+    point3 point(const point3& p) const { return vector(p) + offset; }
+
+    rigid_transform operator*(const rigid_transform& inner) const {
+        // Transform that applies `inner` first, then this one.
+        return rigid_transform(angle + inner.angle, vector(inner.offset) + offset);
+    }
+
+    // Applies the transform to `object`, baking it into the geometry when possible and wrapping
+    // the object in translate/rotate_y otherwise. Defined after the wrapper classes.
+    std::shared_ptr<hittable> apply(
+        const std::shared_ptr<hittable>& object, const instance_counts& counts) const;
+
+    std::shared_ptr<hittable> wrap(const std::shared_ptr<hittable>& object) const;
+
+private:
+    double sin_theta;
+    double cos_theta;
+};
 
 class hit_record
 {
 public:
     point3 p;
     vec3 normal;
-    std::shared_ptr<material> mat;
+    material* mat;  // Non-owning; the hittable that set it keeps the material alive
     double t;
     double u;
     double v;
     bool front_face;
 
+    // Set by hittable::intersect() when only the distance is known so far: the object that owns
+    // the hit, and which of its primitives was hit. The object may also leave barycentrics or
+    // other parametric coordinates in u & v for its set_surface() to pick up.
+    const hittable* object;
+    std::uint32_t prim;
+
     void set_face_normal(const ray &r, const vec3 &outward_normal)
     {
         // Sets the hit record normal vector.
@@ -33,9 +89,67 @@ public:
 
     virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0;
 
+    virtual bool intersect(const ray &r, interval ray_t, hit_record &rec) const {
+        // First phase of a hit: finds the closest intersection in ray_t and sets rec.t, but may
+        // defer the surface attributes by pointing rec.object at the primitive that owns them.
+        // The default performs a complete hit, which leaves nothing to defer.
+        if (!hit(r, ray_t, rec))
+            return false;
+        rec.object = nullptr;
+        return true;
+    }
+
+    virtual void set_surface(const ray &r, hit_record &rec) const {
+        // Second phase: fills in the point, normal, UV & material of a hit found by intersect().
+    }
+
     virtual aabb bounding_box() const = 0;
+
+    virtual aabb bounding_box_at(double time) const {
+        // Bounds of the object at the given ray time. Defaults to the bounds over the whole
+        // shutter interval, which is always conservative.
+        return bounding_box();
+    }
+
+    virtual std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const
+    {
+        // Returns a copy of the object with `xf` baked into its world-space geometry, or nullptr
+        // when the object is unchanged (identity transform) or cannot be baked, in which case it
+        // stays behind transform wrappers.
+        return nullptr;
+    }
+
+    virtual void count_instances(instance_counts& counts) const {
+        // Containers and wrappers forward this to their children; see bake_transforms().
+    }
+
+protected:
+    bool two_phase_hit(const ray &r, interval ray_t, hit_record &rec) const {
+        // hit() for objects that override intersect(): surface attributes are only computed
+        // for the final closest hit, not for every candidate found along the way.
+        if (!intersect(r, ray_t, rec))
+            return false;
+        if (rec.object)
+            rec.object->set_surface(r, rec);
+        return true;
+    }
 };
 
+inline std::shared_ptr<hittable> bake_wrapped(
+    const std::shared_ptr<hittable>& object, const rigid_transform& combined,
+    const rigid_transform& outer, const instance_counts& counts)
+{
+    // Bakes a wrapper whose own transform, composed with the outer one, is `combined`. Objects
+    // placed by several wrappers are shared instances: they are kept as they are and only the
+    // wrappers are rebuilt (if anything changed at all).
+    auto found = counts.find(object.get());
+    if (found != counts.end() && found->second > 1)
+        return outer.is_identity() ? nullptr : combined.wrap(object);
+
+    return combined.apply(object, counts);
+}
+
 class translate : public hittable
 {
 public:
@@ -62,6 +176,21 @@ public:
 
     aabb bounding_box() const override { return bbox; }
 
+    aabb bounding_box_at(double time) const override {
+        return object->bounding_box_at(time) + offset;
+    }
+
+    std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const override
+    {
+        return bake_wrapped(object, xf * rigid_transform(0, offset), xf, counts);
+    }
+
+    void count_instances(instance_counts& counts) const override {
+        if (counts[object.get()]++ == 0)
+            object->count_instances(counts);
+    }
+
 private:
     std::shared_ptr<hittable> object;
     vec3 offset;
@@ -70,7 +199,7 @@ private:
 
 class rotate_y : public hittable {
   public:
-  rotate_y(std::shared_ptr<hittable> object, double angle) : object(object) {
+  rotate_y(std::shared_ptr<hittable> object, double angle) : object(object), angle(angle) {
         auto radians = degrees_to_radians(angle);
         sin_theta = std::sin(radians);
         cos_theta = std::cos(radians);
@@ -144,11 +273,55 @@ class rotate_y : public hittable {
 
     aabb bounding_box() const override { return bbox; }
 
+    std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const override
+    {
+        return bake_wrapped(object, xf * rigid_transform(angle, vec3(0,0,0)), xf, counts);
+    }
+
+    void count_instances(instance_counts& counts) const override {
+        if (counts[object.get()]++ == 0)
+            object->count_instances(counts);
+    }
+
   private:
     std::shared_ptr<hittable> object;
+    double angle;
     double sin_theta;
     double cos_theta;
     aabb bbox;
 };
 
+inline std::shared_ptr<hittable> rigid_transform::apply(
+    const std::shared_ptr<hittable>& object, const instance_counts& counts) const
+{
+    auto baked = object->transformed(*this, counts);
+    return baked ? baked : wrap(object);
+}
+
+inline std::shared_ptr<hittable> rigid_transform::wrap(const std::shared_ptr<hittable>& object) const {
+    auto result = object;
+    if (angle != 0)
+        result = std::make_shared<rotate_y>(result, angle);
+    if (offset.length_squared() != 0)
+        result = std::make_shared<translate>(result, offset);
+    return result;
+}
+
+inline std::shared_ptr<hittable> bake_transforms(
+    std::shared_ptr<hittable> object, bool keep_shared_instances = true)
+{
+    // Scene compilation step that removes translate/rotate_y wrappers by moving the wrapped
+    // primitives into world space, so rays no longer get transformed on the way in and hit
+    // records on the way out. Objects that cannot be baked (e.g. a rotated axis-aligned box)
+    // keep a single combined wrapper. With `keep_shared_instances`, objects placed by more than
+    // one wrapper are left instanced instead of being copied for each placement.
+    instance_counts counts;
+    if (keep_shared_instances)
+        object->count_instances(counts);
+
+    auto baked = object->transformed(rigid_transform(), counts);
+    return baked ? baked : object;
+}
+
 #endif
\ No newline at end of file
@@ -24,17 +24,21 @@ public:
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
     {
-        hit_record temp_rec;
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        // Children only write `rec` when they report a closer hit, so it is passed straight through.
         bool hit_anything = false;
         auto closest_so_far = ray_t.max;
 
         for (const auto &object : objects)
         {
-            if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec))
+            if (object->intersect(r, interval(ray_t.min, closest_so_far), rec))
             {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                closest_so_far = rec.t;
             }
         }
 
@@ -43,6 +47,34 @@ public:
 
     aabb bounding_box() const override { return bbox; }
 
+    aabb bounding_box_at(double time) const override {
+        auto box = aabb::empty;
+        for (const auto &object : objects)
+            box = aabb(box, object->bounding_box_at(time));
+        return box;
+    }
+
+    std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const override
+    {
+        auto result = std::make_shared<hittable_list>();
+        bool changed = false;
+        for (const auto &object : objects)
+        {
+            auto baked = object->transformed(xf, counts);
+            changed |= bool(baked) || !xf.is_identity();
+            result->add(baked ? baked : xf.wrap(object));
+        }
+
+        return changed ? result : nullptr;
+    }
+
+    void count_instances(instance_counts &counts) const override
+    {
+        for (const auto &object : objects)
+            object->count_instances(counts);
+    }
+
 private:
     aabb bbox;
 };
@@ -6,10 +6,13 @@
 #include "material.h"
 #include <omp.h>
 #include "bvh.h"
+#include "motion_bvh.h"
 #include "texture.h"
 #include "quad.h"
 #include "constant_medium.h"
 #include "box.h"
+#include "mesh_loader.h"
+#include "sphere_set.h"
 
 using namespace std;
 
@@ -132,7 +135,7 @@ void bouncing_spheres() {
     auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
 
-    world = hittable_list(make_shared<bvh_node>(world.objects, 0, world.objects.size()));
+    world = hittable_list(make_shared<motion_bvh>(world.objects));
     
     camera cam;
 
@@ -202,6 +205,36 @@ void earth() {
     cam.render(hittable_list(globe));
 }
 
+void mesh_model(const char* filename) {
+    auto model = mesh_loader(filename).mesh(make_shared<lambertian>(color(.73, .73, .73)));
+    auto bbox = model->bounding_box();
+
+    hittable_list world;
+    world.add(model);
+
+    // Frame the model from slightly above, whatever units it was authored in.
+    auto center = point3((bbox.x.min + bbox.x.max) / 2, (bbox.y.min + bbox.y.max) / 2,
+                         (bbox.z.min + bbox.z.max) / 2);
+    auto extent = std::fmax(bbox.x.size(), std::fmax(bbox.y.size(), bbox.z.size()));
+
+    camera cam;
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 100;
+    cam.max_depth         = 50;
+    cam.background        = color(0.70, 0.80, 1.00);
+
+    cam.vfov     = 30;
+    cam.lookfrom = center + extent * vec3(0.5, 0.8, 2.2);
+    cam.lookat   = center;
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    cam.render(world);
+}
+
 void perlin_spheres() {
     hittable_list world;
 
@@ -306,12 +339,12 @@ void cornell_box() {
     world.add(make_shared<quad>(point3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), white));
     world.add(make_shared<quad>(point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white));
 
-    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165,330,165), white);
+    shared_ptr<hittable> box1 = make_shared<box>(point3(0,0,0), point3(165,330,165), white);
     box1 = make_shared<rotate_y>(box1, 15);
     box1 = make_shared<translate>(box1, vec3(265,0,295));
     world.add(box1);
 
-    shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165,165,165), white);
+    shared_ptr<hittable> box2 = make_shared<box>(point3(0,0,0), point3(165,165,165), white);
     box2 = make_shared<rotate_y>(box2, -18);
     box2 = make_shared<translate>(box2, vec3(130,0,65));
     world.add(box2);
@@ -350,11 +383,11 @@ void cornell_smoke() {
     world.add(make_shared<quad>(point3(0,0,0), vec3(555,0,0), vec3(0,0,555), white));
     world.add(make_shared<quad>(point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white));
 
-    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165,330,165), white);
+    shared_ptr<hittable> box1 = make_shared<box>(point3(0,0,0), point3(165,330,165), white);
     box1 = make_shared<rotate_y>(box1, 15);
     box1 = make_shared<translate>(box1, vec3(265,0,295));
 
-    shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165,165,165), white);
+    shared_ptr<hittable> box2 = make_shared<box>(point3(0,0,0), point3(165,165,165), white);
     box2 = make_shared<rotate_y>(box2, -18);
     box2 = make_shared<translate>(box2, vec3(130,0,65));
 
@@ -394,7 +427,7 @@ void final_scene(int image_width, int samples_per_pixel, int max_depth) {
             auto y1 = random_double(1,101);
             auto z1 = z0 + w;
 
-            boxes1.add(box(point3(x0,y0,z0), point3(x1,y1,z1), ground));
+            boxes1.add(make_shared<box>(point3(x0,y0,z0), point3(x1,y1,z1), ground));
         }
     }
 
@@ -426,19 +459,20 @@ void final_scene(int image_width, int samples_per_pixel, int max_depth) {
     auto pertext = make_shared<noise_texture>(0.2);
     world.add(make_shared<sphere>(point3(220,280,300), 80, make_shared<lambertian>(pertext)));
 
-    hittable_list boxes2;
+    auto boxes2 = make_shared<sphere_set>();
     auto white = make_shared<lambertian>(color(.73, .73, .73));
     int ns = 1000;
     for (int j = 0; j < ns; j++) {
-        boxes2.add(make_shared<sphere>(point3::random(0,165), 10, white));
+        boxes2->add(point3::random(0,165), 10, white);
     }
+    boxes2->build();
 
-    world.add(make_shared<translate>(
-        make_shared<rotate_y>(
-            make_shared<bvh_node>(boxes2.objects, 0, boxes2.objects.size()), 15),
+    // Placed once, so the transforms are baked into the sphere centers.
+    world.add(bake_transforms(make_shared<translate>(
+        make_shared<rotate_y>(boxes2, 15),
             vec3(-100,270,395)
         )
-    );
+    ));
 
     camera cam;
 
@@ -470,6 +504,7 @@ int main() {
         case 8:  cornell_smoke();             break;
         case 9:  final_scene(800, 10000, 40); break;
         case 10: custom_scene();              break;
+        case 11: mesh_model("bunny.obj");     break;
         default: final_scene(400,   250,  4); break;
     }
 }
\ No newline at end of file
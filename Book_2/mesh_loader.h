@@ -0,0 +1,619 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "rtweekend.h"
+#include "triangle_mesh.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <omp.h>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+class mapped_file {
+  public:
+    mapped_file(const std::string& filename) {
+        // Maps the whole file read-only into memory. If the file cannot be opened or mapped,
+        // data() returns nullptr and size() returns 0.
+
+      #ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return;
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) return;
+
+        bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (bytes != nullptr) length = size_t(file_size.QuadPart);
+      #else
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) return;
+
+        void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) return;
+
+        bytes = static_cast<const char*>(p);
+        length = size_t(st.st_size);
+      #endif
+    }
+
+    ~mapped_file() {
+      #ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+      #else
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+        if (fd >= 0) close(fd);
+      #endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+  private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+
+  #ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+  #else
+    int fd = -1;
+  #endif
+};
+
+
+class mesh_loader {
+  public:
+    mesh_loader(const char* mesh_filename) {
+        // Loads a Wavefront OBJ or binary PLY file, chosen by file extension. If the RTW_MODELS
+        // environment variable is defined, looks only in that directory for the file. Otherwise
+        // searches the current directory, then the models/ subdirectory, then the _parent's_
+        // models/ subdirectory, and so on for six levels up. If the mesh was not loaded
+        // successfully, triangle_count() returns 0 and mesh() yields an empty mesh.
+
+        auto filename = std::string(mesh_filename);
+        auto modeldir = getenv("RTW_MODELS");
+
+        if (modeldir) {
+            if (load(std::string(modeldir) + "/" + filename)) return;
+        } else {
+            std::string prefix = "models/";
+            if (load(filename)) return;
+            for (int level = 0; level < 7; level++, prefix = "../" + prefix)
+                if (load(prefix + filename)) return;
+        }
+
+        std::cerr << "ERROR: Could not load mesh file '" << mesh_filename << "'.\n";
+    }
+
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    std::shared_ptr<triangle_mesh> mesh(std::shared_ptr<material> mat) {
+        // Hands the loaded buffers over to a new triangle_mesh; the loader is empty afterwards.
+        return std::make_shared<triangle_mesh>(
+            std::move(positions), std::move(indices), mat, std::move(normals), std::move(uvs));
+    }
+
+  private:
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> uvs;
+    std::vector<std::uint32_t> indices;
+
+    bool load(const std::string& filename) {
+        mapped_file file(filename);
+        if (file.data() == nullptr)
+            return false;
+
+        auto dot = filename.find_last_of('.');
+        auto ext = (dot == std::string::npos) ? std::string() : filename.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+        if (ext == "obj") return load_obj(file.data(), file.data() + file.size());
+        if (ext == "ply") return load_ply(file.data(), file.data() + file.size());
+
+        std::cerr << "ERROR: Unsupported mesh format '" << filename << "'.\n";
+        return false;
+    }
+
+    // ---------------------------------------------------------------------------------------
+    // Wavefront OBJ
+
+    struct obj_corner {
+        std::int64_t index[3];    // Position, texture coordinate and normal indices
+        std::uint8_t present;     // Bit k set if index[k] was given
+        std::uint8_t relative;    // Bit k set if index[k] is relative to the chunk start
+    };
+
+    struct obj_chunk {
+        std::vector<float> v, vt, vn;
+        std::vector<obj_corner> corners;    // Three per triangle, after fan triangulation
+    };
+
+    static const char* skip_space(const char* p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        return p;
+    }
+
+    static const char* parse_floats(const char* p, const char* end, int n, std::vector<float>& out) {
+        for (int i = 0; i < n; i++) {
+            float value = 0;
+            p = skip_space(p, end);
+            auto result = std::from_chars(p, end, value);
+            p = result.ptr;
+            out.push_back(value);
+        }
+        return p;
+    }
+
+    static void parse_obj_chunk(const char* p, const char* end, obj_chunk& chunk) {
+        std::vector<obj_corner> face;
+
+        while (p < end) {
+            auto line_end = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+            if (!line_end) line_end = end;
+
+            p = skip_space(p, line_end);
+            if (line_end - p >= 2 && p[0] == 'v' && p[1] == ' ') {
+                parse_floats(p + 2, line_end, 3, chunk.v);
+            } else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 't' && p[2] == ' ') {
+                parse_floats(p + 3, line_end, 2, chunk.vt);
+            } else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 'n' && p[2] == ' ') {
+                parse_floats(p + 3, line_end, 3, chunk.vn);
+            } else if (line_end - p >= 2 && p[0] == 'f' && p[1] == ' ') {
+                std::int64_t counts[3] = {
+                    std::int64_t(chunk.v.size() / 3),
+                    std::int64_t(chunk.vt.size() / 2),
+                    std::int64_t(chunk.vn.size() / 3)
+                };
+
+                face.clear();
+                p += 2;
+                while ((p = skip_space(p, line_end)) < line_end && *p != '\r') {
+                    obj_corner corner = {{-1, -1, -1}, 0, 0};
+
+                    // Corner syntax is v, v/vt, v//vn or v/vt/vn.
+                    for (int k = 0; k < 3; k++) {
+                        std::int64_t idx = 0;
+                        auto result = std::from_chars(p, line_end, idx);
+                        if (result.ptr != p && idx != 0) {
+                            corner.present |= std::uint8_t(1 << k);
+                            if (idx > 0) {
+                                corner.index[k] = idx - 1;
+                            } else {
+                                corner.index[k] = counts[k] + idx;
+                                corner.relative |= std::uint8_t(1 << k);
+                            }
+                        }
+                        p = result.ptr;
+                        if (p >= line_end || *p != '/') break;
+                        p++;
+                    }
+                    while (p < line_end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+
+                    face.push_back(corner);
+                }
+
+                for (size_t i = 1; i + 1 < face.size(); i++) {
+                    chunk.corners.push_back(face[0]);
+                    chunk.corners.push_back(face[i]);
+                    chunk.corners.push_back(face[i+1]);
+                }
+            }
+
+            p = line_end + 1;
+        }
+    }
+
+    struct corner_hash {
+        size_t operator()(const obj_corner& c) const {
+            auto h = std::hash<std::int64_t>()(c.index[0]);
+            h = h * 1000003u ^ std::hash<std::int64_t>()(c.index[1]);
+            h = h * 1000003u ^ std::hash<std::int64_t>()(c.index[2]);
+            return h;
+        }
+    };
+
+    struct corner_equal {
+        bool operator()(const obj_corner& a, const obj_corner& b) const {
+            return a.index[0] == b.index[0] && a.index[1] == b.index[1] && a.index[2] == b.index[2];
+        }
+    };
+
+    bool load_obj(const char* begin, const char* end) {
+        // Split the file into line-aligned chunks and parse them in parallel.
+        int chunk_count = std::max(1, omp_get_max_threads() * 4);
+        std::vector<const char*> bounds(chunk_count + 1, end);
+        bounds[0] = begin;
+        for (int c = 1; c < chunk_count; c++) {
+            auto p = std::max(bounds[c-1], begin + (end - begin) * c / chunk_count);
+            auto nl = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+            bounds[c] = nl ? nl + 1 : end;
+        }
+
+        std::vector<obj_chunk> chunks(chunk_count);
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int c = 0; c < chunk_count; c++)
+            parse_obj_chunk(bounds[c], bounds[c+1], chunks[c]);
+
+        // Concatenate the attributes and turn chunk-relative indices into global ones.
+        std::vector<float> v, vt, vn;
+        for (auto& chunk : chunks) {
+            std::int64_t offsets[3] = {
+                std::int64_t(v.size() / 3), std::int64_t(vt.size() / 2), std::int64_t(vn.size() / 3)
+            };
+            for (auto& corner : chunk.corners)
+                for (int k = 0; k < 3; k++)
+                    if (corner.relative & (1 << k))
+                        corner.index[k] += offsets[k];
+
+            v.insert(v.end(), chunk.v.begin(), chunk.v.end());
+            vt.insert(vt.end(), chunk.vt.begin(), chunk.vt.end());
+            vn.insert(vn.end(), chunk.vn.begin(), chunk.vn.end());
+        }
+
+        // Only keep texture coordinates and normals if every corner references valid ones.
+        auto vertex_count = std::int64_t(v.size() / 3);
+        bool has_uvs = !vt.empty(), has_normals = !vn.empty();
+        for (const auto& chunk : chunks) {
+            for (const auto& corner : chunk.corners) {
+                if (corner.index[0] < 0 || corner.index[0] >= vertex_count) {
+                    std::cerr << "ERROR: OBJ face references a missing vertex.\n";
+                    return false;
+                }
+                has_uvs = has_uvs && corner.index[1] >= 0
+                                  && corner.index[1] < std::int64_t(vt.size() / 2);
+                has_normals = has_normals && corner.index[2] >= 0
+                                          && corner.index[2] < std::int64_t(vn.size() / 3);
+            }
+        }
+
+        if (!has_uvs && !has_normals) {
+            // Positions alone are already shared; use the OBJ indices directly.
+            for (const auto& chunk : chunks)
+                for (const auto& corner : chunk.corners)
+                    indices.push_back(std::uint32_t(corner.index[0]));
+            positions = std::move(v);
+            return true;
+        }
+
+        // Deduplicate position/texture/normal triples into single mesh vertices.
+        std::unordered_map<obj_corner, std::uint32_t, corner_hash, corner_equal> vertex_ids;
+        for (const auto& chunk : chunks) {
+            for (auto corner : chunk.corners) {
+                if (!has_uvs)     corner.index[1] = -1;
+                if (!has_normals) corner.index[2] = -1;
+
+                auto inserted = vertex_ids.emplace(corner, std::uint32_t(positions.size() / 3));
+                if (inserted.second) {
+                    auto i = size_t(corner.index[0]);
+                    positions.insert(positions.end(), &v[3*i], &v[3*i + 3]);
+                    if (has_uvs) {
+                        auto j = size_t(corner.index[1]);
+                        uvs.insert(uvs.end(), &vt[2*j], &vt[2*j + 2]);
+                    }
+                    if (has_normals) {
+                        auto j = size_t(corner.index[2]);
+                        normals.insert(normals.end(), &vn[3*j], &vn[3*j + 3]);
+                    }
+                }
+                indices.push_back(inserted.first->second);
+            }
+        }
+
+        return true;
+    }
+
+    // ---------------------------------------------------------------------------------------
+    // Binary PLY
+
+    enum class ply_type { none, int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+    struct ply_property {
+        std::string name;
+        ply_type type = ply_type::none;
+        ply_type count_type = ply_type::none;   // Set only for list properties
+        size_t offset = 0;
+    };
+
+    struct ply_element {
+        std::string name;
+        size_t count = 0;
+        size_t stride = 0;                      // Record size, if no property is a list
+        std::vector<ply_property> properties;
+    };
+
+    static ply_type parse_ply_type(const std::string& s) {
+        if (s == "char"   || s == "int8")    return ply_type::int8;
+        if (s == "uchar"  || s == "uint8")   return ply_type::uint8;
+        if (s == "short"  || s == "int16")   return ply_type::int16;
+        if (s == "ushort" || s == "uint16")  return ply_type::uint16;
+        if (s == "int"    || s == "int32")   return ply_type::int32;
+        if (s == "uint"   || s == "uint32")  return ply_type::uint32;
+        if (s == "float"  || s == "float32") return ply_type::float32;
+        if (s == "double" || s == "float64") return ply_type::float64;
+        return ply_type::none;
+    }
+
+    static size_t ply_size(ply_type t) {
+        switch (t) {
+            case ply_type::int8:  case ply_type::uint8:   return 1;
+            case ply_type::int16: case ply_type::uint16:  return 2;
+            case ply_type::int32: case ply_type::uint32: case ply_type::float32: return 4;
+            case ply_type::float64: return 8;
+            default: return 0;
+        }
+    }
+
+    static double read_ply(const char* p, ply_type t, bool swap) {
+        unsigned char b[8];
+        auto n = ply_size(t);
+        std::memcpy(b, p, n);
+        if (swap) std::reverse(b, b + n);
+
+        switch (t) {
+            case ply_type::int8:    { std::int8_t   x; std::memcpy(&x, b, n); return x; }
+            case ply_type::uint8:   { std::uint8_t  x; std::memcpy(&x, b, n); return x; }
+            case ply_type::int16:   { std::int16_t  x; std::memcpy(&x, b, n); return x; }
+            case ply_type::uint16:  { std::uint16_t x; std::memcpy(&x, b, n); return x; }
+            case ply_type::int32:   { std::int32_t  x; std::memcpy(&x, b, n); return x; }
+            case ply_type::uint32:  { std::uint32_t x; std::memcpy(&x, b, n); return x; }
+            case ply_type::float32: { float         x; std::memcpy(&x, b, n); return x; }
+            case ply_type::float64: { double        x; std::memcpy(&x, b, n); return x; }
+            default: return 0;
+        }
+    }
+
+    bool load_ply(const char* begin, const char* end) {
+        // Parse the ASCII header.
+        static const char header_end[] = "end_header";
+        auto header_stop = std::search(begin, end, header_end, header_end + sizeof(header_end) - 1);
+        if (header_stop == end) return false;
+        auto body = static_cast<const char*>(std::memchr(header_stop, '\n', size_t(end - header_stop)));
+        if (!body) return false;
+        body++;
+
+        std::istringstream header(std::string(begin, header_stop));
+        std::vector<ply_element> elements;
+        std::string line, format;
+        while (std::getline(header, line)) {
+            std::istringstream tokens(line);
+            std::string keyword;
+            tokens >> keyword;
+
+            if (keyword == "format") {
+                tokens >> format;
+            } else if (keyword == "element") {
+                ply_element element;
+                tokens >> element.name >> element.count;
+                elements.push_back(element);
+            } else if (keyword == "property" && !elements.empty()) {
+                auto& element = elements.back();
+                ply_property prop;
+                std::string type;
+                tokens >> type;
+                if (type == "list") {
+                    std::string count_type, item_type;
+                    tokens >> count_type >> item_type;
+                    prop.count_type = parse_ply_type(count_type);
+                    prop.type = parse_ply_type(item_type);
+                } else {
+                    prop.type = parse_ply_type(type);
+                }
+                tokens >> prop.name;
+                prop.offset = element.stride;
+                element.stride += ply_size(prop.type);
+                element.properties.push_back(prop);
+            }
+        }
+
+        bool little = (format == "binary_little_endian");
+        if (!little && format != "binary_big_endian") {
+            std::cerr << "ERROR: Only binary PLY files are supported.\n";
+            return false;
+        }
+        const std::uint16_t probe = 1;
+        bool host_little = *reinterpret_cast<const unsigned char*>(&probe) == 1;
+        bool swap = little != host_little;
+
+        auto p = body;
+        for (const auto& element : elements) {
+            bool has_list = std::any_of(element.properties.begin(), element.properties.end(),
+                [](const ply_property& prop) { return prop.count_type != ply_type::none; });
+
+            if (element.name == "vertex") {
+                if (has_list || size_t(end - p) < element.count * element.stride) return false;
+                read_ply_vertices(element, p, swap);
+                p += element.count * element.stride;
+            } else if (element.name == "face") {
+                if (element.properties.size() != 1 || !has_list) {
+                    std::cerr << "ERROR: PLY faces must have a single vertex index list.\n";
+                    return false;
+                }
+                p = read_ply_faces(element, p, end, swap);
+                if (!p) return false;
+            } else if (!has_list) {
+                p += element.count * element.stride;
+            } else {
+                break;  // Unknown variable-size element; everything we need comes before it.
+            }
+        }
+
+        auto vertex_count = positions.size() / 3;
+        if (std::any_of(indices.begin(), indices.end(),
+                [vertex_count](std::uint32_t i) { return i >= vertex_count; })) {
+            std::cerr << "ERROR: PLY face references a missing vertex.\n";
+            return false;
+        }
+
+        weld_vertices();
+        return true;
+    }
+
+    void read_ply_vertices(const ply_element& element, const char* p, bool swap) {
+        const ply_property* x[3] = {};
+        const ply_property* n[3] = {};
+        const ply_property* uv[2] = {};
+        for (const auto& prop : element.properties) {
+            const auto& s = prop.name;
+            if (s == "x")  x[0] = &prop;
+            if (s == "y")  x[1] = &prop;
+            if (s == "z")  x[2] = &prop;
+            if (s == "nx") n[0] = &prop;
+            if (s == "ny") n[1] = &prop;
+            if (s == "nz") n[2] = &prop;
+            if (s == "u" || s == "s" || s == "texture_u") uv[0] = &prop;
+            if (s == "v" || s == "t" || s == "texture_v") uv[1] = &prop;
+        }
+
+        bool has_normals = n[0] && n[1] && n[2];
+        bool has_uvs = uv[0] && uv[1];
+        auto count = std::int64_t(element.count);
+
+        positions.resize(3 * element.count);
+        if (has_normals) normals.resize(3 * element.count);
+        if (has_uvs) uvs.resize(2 * element.count);
+
+        // Vertex records have a fixed size, so every vertex can be decoded independently.
+        #pragma omp parallel for
+        for (std::int64_t i = 0; i < count; i++) {
+            auto record = p + i * element.stride;
+            for (int k = 0; k < 3; k++) {
+                positions[3*i + k] = x[k] ? float(read_ply(record + x[k]->offset, x[k]->type, swap)) : 0;
+                if (has_normals)
+                    normals[3*i + k] = float(read_ply(record + n[k]->offset, n[k]->type, swap));
+            }
+            if (has_uvs)
+                for (int k = 0; k < 2; k++)
+                    uvs[2*i + k] = float(read_ply(record + uv[k]->offset, uv[k]->type, swap));
+        }
+    }
+
+    const char* read_ply_faces(const ply_element& element, const char* p, const char* end, bool swap) {
+        const auto& list = element.properties[0];
+        auto count_size = ply_size(list.count_type);
+        auto index_size = ply_size(list.type);
+        auto face_count = std::int64_t(element.count);
+
+        // Fast path: if every face is a triangle, records have a fixed stride and can be
+        // decoded in parallel.
+        auto stride = count_size + 3 * index_size;
+        if (size_t(end - p) >= element.count * stride) {
+            indices.resize(3 * element.count);
+            bool all_triangles = true;
+
+            #pragma omp parallel for reduction(&&:all_triangles)
+            for (std::int64_t f = 0; f < face_count; f++) {
+                auto record = p + f * stride;
+                all_triangles = all_triangles && read_ply(record, list.count_type, swap) == 3;
+                for (int k = 0; k < 3; k++)
+                    indices[3*f + k] = std::uint32_t(
+                        read_ply(record + count_size + k * index_size, list.type, swap));
+            }
+
+            if (all_triangles)
+                return p + element.count * stride;
+            indices.clear();
+        }
+
+        // General polygons: walk the records sequentially and fan-triangulate.
+        for (std::int64_t f = 0; f < face_count; f++) {
+            if (size_t(end - p) < count_size) return nullptr;
+            auto n = size_t(read_ply(p, list.count_type, swap));
+            p += count_size;
+            if (size_t(end - p) < n * index_size) return nullptr;
+
+            auto corner = [&](size_t k) {
+                return std::uint32_t(read_ply(p + k * index_size, list.type, swap));
+            };
+            for (size_t k = 1; k + 1 < n; k++) {
+                indices.push_back(corner(0));
+                indices.push_back(corner(k));
+                indices.push_back(corner(k+1));
+            }
+            p += n * index_size;
+        }
+
+        return p;
+    }
+
+    void weld_vertices() {
+        // Merge vertices whose attributes are bit-for-bit identical, which exporters often emit
+        // along UV seams and hard edges that turn out not to need a split.
+
+        auto vertex_count = positions.size() / 3;
+        auto attribute_count = 3 + (normals.empty() ? 0 : 3) + (uvs.empty() ? 0 : 2);
+
+        auto key = [&](size_t i) {
+            std::string k(attribute_count * sizeof(float), '\0');
+            auto out = &k[0];
+            std::memcpy(out, &positions[3*i], 3 * sizeof(float));
+            out += 3 * sizeof(float);
+            if (!normals.empty()) {
+                std::memcpy(out, &normals[3*i], 3 * sizeof(float));
+                out += 3 * sizeof(float);
+            }
+            if (!uvs.empty())
+                std::memcpy(out, &uvs[2*i], 2 * sizeof(float));
+            return k;
+        };
+
+        std::unordered_map<std::string, std::uint32_t> first_occurrence;
+        std::vector<std::uint32_t> remap(vertex_count);
+        std::vector<float> welded_positions, welded_normals, welded_uvs;
+
+        for (size_t i = 0; i < vertex_count; i++) {
+            auto inserted = first_occurrence.emplace(key(i), std::uint32_t(welded_positions.size() / 3));
+            remap[i] = inserted.first->second;
+            if (!inserted.second) continue;
+
+            welded_positions.insert(welded_positions.end(), &positions[3*i], &positions[3*i + 3]);
+            if (!normals.empty())
+                welded_normals.insert(welded_normals.end(), &normals[3*i], &normals[3*i + 3]);
+            if (!uvs.empty())
+                welded_uvs.insert(welded_uvs.end(), &uvs[2*i], &uvs[2*i + 2]);
+        }
+
+        if (welded_positions.size() == positions.size())
+            return;
+
+        for (auto& index : indices)
+            index = remap[index];
+
+        positions = std::move(welded_positions);
+        normals = std::move(welded_normals);
+        uvs = std::move(welded_uvs);
+    }
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef MOTION_BVH_H
+#define MOTION_BVH_H
+
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "ray.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// BVH for scenes with moving objects. Every node stores its bounds at the start and end of its
+// time segment and linearly interpolates them at the ray's time, so a fast-moving sphere only
+// occupies the space it actually covers at that instant instead of the union of its keyframes.
+// Optionally the shutter interval is cut into uniform time segments, each with its own tree,
+// which keeps long motions from stretching the upper levels of a single tree.
+class motion_bvh : public hittable {
+  public:
+    motion_bvh(const std::vector<std::shared_ptr<hittable>>& objects, int time_segments = 1)
+      : primitives(objects), segments(std::max(1, time_segments))
+    {
+        for (const auto& object : primitives)
+            bbox = aabb(bbox, object->bounding_box());
+
+        if (primitives.empty())
+            return;
+
+        roots.resize(segments);
+        for (int s = 0; s < segments; s++) {
+            auto t0 = double(s) / segments;
+            auto t1 = double(s+1) / segments;
+
+            std::vector<prim_ref> refs(primitives.size());
+            for (size_t i = 0; i < primitives.size(); i++) {
+                refs[i].index = std::uint32_t(i);
+                refs[i].box0  = primitives[i]->bounding_box_at(t0);
+                refs[i].box1  = primitives[i]->bounding_box_at(t1);
+            }
+
+            roots[s] = build(refs, 0, refs.size());
+        }
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (primitives.empty())
+            return false;
+
+        // Select the time segment and the interpolation weight within it.
+        auto time = interval(0, 1).clamp(r.time());
+        int segment = std::min(int(time * segments), segments - 1);
+        auto s = time * segments - segment;
+
+        std::uint32_t stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = roots[segment];
+
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+
+        while (stack_size > 0) {
+            auto ref = stack[--stack_size];
+
+            if (is_leaf(ref)) {
+                const auto& object = primitives[leaf_index(ref)];
+                if (object->intersect(r, interval(ray_t.min, closest_so_far), rec)) {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+                continue;
+            }
+
+            const auto& n = nodes[ref];
+            if (!lerp(n.box0, n.box1, s).hit(r, interval(ray_t.min, closest_so_far)))
+                continue;
+
+            stack[stack_size++] = n.child[1];
+            stack[stack_size++] = n.child[0];
+        }
+
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+  private:
+    struct prim_ref {
+        std::uint32_t index;
+        aabb box0, box1;    // Primitive bounds at the start and end of the time segment
+    };
+
+    struct node {
+        aabb box0, box1;    // Node bounds at the start and end of the time segment
+        std::uint32_t child[2];
+    };
+
+    static constexpr std::uint32_t leaf_flag = 0x80000000u;
+
+    std::vector<std::shared_ptr<hittable>> primitives;
+    std::vector<node> nodes;
+    std::vector<std::uint32_t> roots;
+    int segments;
+    aabb bbox;
+
+    static bool is_leaf(std::uint32_t ref) { return (ref & leaf_flag) != 0; }
+    static std::uint32_t leaf_index(std::uint32_t ref) { return ref & ~leaf_flag; }
+
+    static aabb lerp(const aabb& a, const aabb& b, double s) {
+        // Interpolating both keyframe boxes of a node always encloses the interpolated boxes
+        // of its children, so the tree stays conservative for linearly moving primitives.
+        auto lerp_interval = [s](const interval& i0, const interval& i1) {
+            return interval(i0.min + s*(i1.min - i0.min), i0.max + s*(i1.max - i0.max));
+        };
+        return aabb(lerp_interval(a.x, b.x), lerp_interval(a.y, b.y), lerp_interval(a.z, b.z));
+    }
+
+    std::uint32_t build(std::vector<prim_ref>& refs, size_t start, size_t end) {
+        size_t object_span = end - start;
+
+        if (object_span == 1)
+            return refs[start].index | leaf_flag;
+
+        // Split on the bounds in the middle of the segment, so the topology matches where the
+        // objects are for most rays rather than where they were at either keyframe.
+        aabb box0, box1, mid_box;
+        for (size_t i = start; i < end; i++) {
+            box0 = aabb(box0, refs[i].box0);
+            box1 = aabb(box1, refs[i].box1);
+            mid_box = aabb(mid_box, lerp(refs[i].box0, refs[i].box1, 0.5));
+        }
+
+        int axis = mid_box.longest_axis();
+        auto mid = start + object_span/2;
+        std::nth_element(std::begin(refs) + start, std::begin(refs) + mid, std::begin(refs) + end,
+            [axis](const prim_ref& a, const prim_ref& b) {
+                auto ca = a.box0.axis_interval(axis).min + a.box1.axis_interval(axis).min;
+                auto cb = b.box0.axis_interval(axis).min + b.box1.axis_interval(axis).min;
+                return ca < cb;
+            });
+
+        auto node_index = std::uint32_t(nodes.size());
+        nodes.push_back({ box0, box1, { 0, 0 } });
+
+        auto left  = build(refs, start, mid);
+        auto right = build(refs, mid, end);
+        nodes[node_index].child[0] = left;
+        nodes[node_index].child[1] = right;
+
+        return node_index;
+    }
+};
+
+#endif
@@ -27,6 +27,10 @@ class quad : public hittable {
     aabb bounding_box() const override { return bbox; }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
         auto denom = dot(normal, r.direction());
 
         // No hit if the ray is parallel to the plane.
@@ -47,14 +51,17 @@ class quad : public hittable {
         if (!is_interior(alpha, beta, rec))
             return false;
 
-        // Ray hits the 2D shape; set the rest of the hit record and return true.
+        // Ray hits the 2D shape; the rest of the hit record is left to set_surface().
         rec.t = t;
-        rec.p = intersection;
-        rec.mat = mat;
-        rec.set_face_normal(r, normal);
+        rec.object = this;
 
         return true;
-    
+    }
+
+    void set_surface(const ray& r, hit_record& rec) const override {
+        rec.p = r.at(rec.t);
+        rec.mat = mat.get();
+        rec.set_face_normal(r, normal);
     }
 
     virtual bool is_interior(double a, double b, hit_record& rec) const {
@@ -70,6 +77,14 @@ class quad : public hittable {
         return true;
     }
 
+    std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const override
+    {
+        if (xf.is_identity())
+            return nullptr;
+        return std::make_shared<quad>(xf.point(Q), xf.vector(u), xf.vector(v), mat);
+    }
+
   private:
     point3 Q;
     vec3 u, v;
@@ -80,27 +95,4 @@ class quad : public hittable {
     double D;
 };
 
-inline std::shared_ptr<hittable_list> box(const point3& a, const point3& b, std::shared_ptr<material> mat)
-{
-    // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
-
-    auto sides = std::make_shared<hittable_list>();
-
-    // Construct the two opposite vertices with the minimum and maximum coordinates.
-    auto min = point3(std::fmin(a.x(),b.x()), std::fmin(a.y(),b.y()), std::fmin(a.z(),b.z()));
-    auto max = point3(std::fmax(a.x(),b.x()), std::fmax(a.y(),b.y()), std::fmax(a.z(),b.z()));
-
-    auto dx = vec3(max.x() - min.x(), 0, 0);
-    auto dy = vec3(0, max.y() - min.y(), 0);
-    auto dz = vec3(0, 0, max.z() - min.z());
-
-    sides->add(std::make_shared<quad>(point3(min.x(), min.y(), max.z()),  dx,  dy, mat)); // front
-    sides->add(std::make_shared<quad>(point3(max.x(), min.y(), max.z()), -dz,  dy, mat)); // right
-    sides->add(std::make_shared<quad>(point3(max.x(), min.y(), min.z()), -dx,  dy, mat)); // back
-    sides->add(std::make_shared<quad>(point3(min.x(), min.y(), min.z()),  dz,  dy, mat)); // left
-    sides->add(std::make_shared<quad>(point3(min.x(), max.y(), max.z()),  dx, -dz, mat)); // top
-    sides->add(std::make_shared<quad>(point3(min.x(), min.y(), min.z()),  dx,  dz, mat)); // bottom
-
-    return sides;
-}
 #endif
\ No newline at end of file
@@ -0,0 +1,157 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Minimal float vector wrapper for packet intersection code. Uses 8-wide AVX when the compiler
+// targets it (/arch:AVX2 or -mavx2), 4-wide SSE on any x86-64 build, and a plain 4-float loop
+// elsewhere, so the intersection routines are written once against `vfloat`/`vmask`.
+
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define RTW_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define RTW_SIMD_SSE
+#endif
+
+
+#if defined(RTW_SIMD_AVX)
+
+constexpr int simd_width = 8;
+
+struct vmask {
+    __m256 m;
+    int bits() const { return _mm256_movemask_ps(m); }
+    bool any() const { return bits() != 0; }
+};
+
+struct vfloat {
+    __m256 v;
+    vfloat() {}
+    vfloat(__m256 v) : v(v) {}
+    vfloat(float x) : v(_mm256_set1_ps(x)) {}
+    static vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+inline vfloat sqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+inline vmask operator<(vfloat a, vfloat b)  { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline vmask operator>(vfloat a, vfloat b)  { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline vmask operator!=(vfloat a, vfloat b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_OQ) }; }
+inline vmask operator&(vmask a, vmask b) { return { _mm256_and_ps(a.m, b.m) }; }
+inline vmask operator|(vmask a, vmask b) { return { _mm256_or_ps(a.m, b.m) }; }
+inline vmask andnot(vmask a, vmask b) { return { _mm256_andnot_ps(b.m, a.m) }; }  // a & ~b
+inline vfloat select(vmask m, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+
+#elif defined(RTW_SIMD_SSE)
+
+constexpr int simd_width = 4;
+
+struct vmask {
+    __m128 m;
+    int bits() const { return _mm_movemask_ps(m); }
+    bool any() const { return bits() != 0; }
+};
+
+struct vfloat {
+    __m128 v;
+    vfloat() {}
+    vfloat(__m128 v) : v(v) {}
+    vfloat(float x) : v(_mm_set1_ps(x)) {}
+    static vfloat load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v, b.v); }
+inline vfloat sqrt(vfloat a) { return _mm_sqrt_ps(a.v); }
+inline vmask operator<(vfloat a, vfloat b)  { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline vmask operator>(vfloat a, vfloat b)  { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline vmask operator!=(vfloat a, vfloat b) { return { _mm_cmpneq_ps(a.v, b.v) }; }
+inline vmask operator&(vmask a, vmask b) { return { _mm_and_ps(a.m, b.m) }; }
+inline vmask operator|(vmask a, vmask b) { return { _mm_or_ps(a.m, b.m) }; }
+inline vmask andnot(vmask a, vmask b) { return { _mm_andnot_ps(b.m, a.m) }; }  // a & ~b
+inline vfloat select(vmask m, vfloat a, vfloat b) {
+    return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v));
+}
+
+#else
+
+constexpr int simd_width = 4;
+
+struct vmask {
+    bool m[simd_width];
+    int bits() const {
+        int b = 0;
+        for (int i = 0; i < simd_width; i++) b |= int(m[i]) << i;
+        return b;
+    }
+    bool any() const { return bits() != 0; }
+};
+
+struct vfloat {
+    float v[simd_width];
+    vfloat() {}
+    vfloat(float x) { for (auto& e : v) e = x; }
+    static vfloat load(const float* p) {
+        vfloat r;
+        for (int i = 0; i < simd_width; i++) r.v[i] = p[i];
+        return r;
+    }
+    void store(float* p) const { for (int i = 0; i < simd_width; i++) p[i] = v[i]; }
+};
+
+#define RTW_SIMD_LANEWISE(result_type, expr) \
+    result_type r; for (int i = 0; i < simd_width; i++) expr; return r;
+
+inline vfloat operator+(vfloat a, vfloat b) { RTW_SIMD_LANEWISE(vfloat, r.v[i] = a.v[i] + b.v[i]) }
+inline vfloat operator-(vfloat a, vfloat b) { RTW_SIMD_LANEWISE(vfloat, r.v[i] = a.v[i] - b.v[i]) }
+inline vfloat operator*(vfloat a, vfloat b) { RTW_SIMD_LANEWISE(vfloat, r.v[i] = a.v[i] * b.v[i]) }
+inline vfloat operator/(vfloat a, vfloat b) { RTW_SIMD_LANEWISE(vfloat, r.v[i] = a.v[i] / b.v[i]) }
+inline vfloat sqrt(vfloat a) { RTW_SIMD_LANEWISE(vfloat, r.v[i] = std::sqrt(a.v[i])) }
+inline vmask operator<(vfloat a, vfloat b)  { RTW_SIMD_LANEWISE(vmask, r.m[i] = a.v[i] < b.v[i]) }
+inline vmask operator>(vfloat a, vfloat b)  { RTW_SIMD_LANEWISE(vmask, r.m[i] = a.v[i] > b.v[i]) }
+inline vmask operator!=(vfloat a, vfloat b) { RTW_SIMD_LANEWISE(vmask, r.m[i] = a.v[i] != b.v[i]) }
+inline vmask operator&(vmask a, vmask b) { RTW_SIMD_LANEWISE(vmask, r.m[i] = a.m[i] && b.m[i]) }
+inline vmask operator|(vmask a, vmask b) { RTW_SIMD_LANEWISE(vmask, r.m[i] = a.m[i] || b.m[i]) }
+inline vmask andnot(vmask a, vmask b) { RTW_SIMD_LANEWISE(vmask, r.m[i] = a.m[i] && !b.m[i]) }
+inline vfloat select(vmask m, vfloat a, vfloat b) {
+    RTW_SIMD_LANEWISE(vfloat, r.v[i] = m.m[i] ? a.v[i] : b.v[i])
+}
+
+#undef RTW_SIMD_LANEWISE
+
+#endif
+
+
+inline vmask lane_mask(int count) {
+    // Mask of the first `count` lanes, for partially filled packets.
+    static const float lane_index[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    return vfloat::load(lane_index) < vfloat(float(count));
+}
+
+inline int closest_lane(vmask valid, vfloat t, float& t_min) {
+    // Returns the valid lane with the smallest t (storing it in t_min), or -1 if none is valid.
+    float ts[simd_width];
+    t.store(ts);
+
+    int lane = -1;
+    int bits = valid.bits();
+    for (int i = 0; i < simd_width; i++) {
+        if ((bits & (1 << i)) && ts[i] < t_min) {
+            t_min = ts[i];
+            lane = i;
+        }
+    }
+    return lane;
+}
+
+#endif
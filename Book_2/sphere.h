@@ -28,6 +28,10 @@ class sphere : public hittable {
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
         point3 current_center = center.at(r.time());
         vec3 oc = current_center - r.origin();
         auto a = r.direction().length_squared();
@@ -49,22 +53,42 @@ class sphere : public hittable {
         }
 
         rec.t = root;
+        rec.object = this;
+
+        return true;
+    }
+
+    void set_surface(const ray& r, hit_record& rec) const override {
         rec.p = r.at(rec.t);
-        vec3 outward_normal = (rec.p - current_center) / radius;
+        vec3 outward_normal = (rec.p - center.at(r.time())) / radius;
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u, rec.v);
-        rec.mat = mat;
-
-        return true;
-      }
+        rec.u = shift_u(rec.u, u_shift);
+        rec.mat = mat.get();
+    }
       
       aabb bounding_box() const override { return bbox; }
 
-  private:
-    ray center;
-    double radius;
-    std::shared_ptr<material> mat;
-    aabb bbox;
+      aabb bounding_box_at(double time) const override {
+        auto rvec = vec3(radius, radius, radius);
+        return aabb(center.at(time) - rvec, center.at(time) + rvec);
+      }
+
+    std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const override
+    {
+        if (xf.is_identity())
+            return nullptr;
+
+        auto center1 = xf.point(center.origin());
+        auto result = (center.direction().length_squared() == 0)
+            ? std::make_shared<sphere>(center1, radius, mat)
+            : std::make_shared<sphere>(center1, center1 + xf.vector(center.direction()), radius, mat);
+
+        // Rotating about y turns the texture coordinates; shift u back so textures stay put.
+        result->u_shift = shift_u(u_shift, -xf.angle / 360);
+        return result;
+    }
 
     static void get_sphere_uv(const point3& p, double& u, double& v) {
         // p: a given point on the sphere of radius one, centered at the origin.
@@ -81,6 +105,20 @@ class sphere : public hittable {
         v = theta / pi;
     }
 
+    static double shift_u(double u, double shift) {
+        // Offsets the longitude coordinate u, wrapping it back into [0,1).
+        if (shift == 0)
+            return u;
+        u = std::fmod(u + shift, 1.0);
+        return (u < 0) ? u + 1 : u;
+    }
+
+  private:
+    ray center;
+    double radius;
+    std::shared_ptr<material> mat;
+    aabb bbox;
+    double u_shift = 0;  // Longitude offset left by baked rotations
 };
 
 #endif
\ No newline at end of file
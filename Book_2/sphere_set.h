@@ -0,0 +1,314 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "simd.h"
+#include "sphere.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+// Large population of stationary spheres stored as one hittable. Centers, radii and material
+// ids live in float SoA packets of `simd_width` spheres, each packet being one leaf of an
+// internal flattened BVH, and every leaf is intersected against the ray in a single SIMD test.
+// Materials are referenced through a small table, so a particle scene costs a few dozen bytes
+// per sphere instead of a heap-allocated `sphere` with its own shared_ptr and bounding box.
+class sphere_set : public hittable {
+  public:
+    sphere_set() {}
+
+    void add(const point3& center, double radius, std::shared_ptr<material> mat) {
+        auto inserted = material_ids.emplace(mat.get(), std::uint32_t(materials.size()));
+        if (inserted.second)
+            materials.push_back(mat);
+
+        // Round to the float precision the packets store, so the BVH bounds match them.
+        auto c = point3(float(center.x()), float(center.y()), float(center.z()));
+        pending.push_back({ c, double(float(std::fmax(0, radius))), inserted.first->second });
+        bbox = aabb(bbox, sphere_box(pending.back()));
+    }
+
+    void build() {
+        // Packs the added spheres into the SIMD leaves; call it before rendering. Spheres packed
+        // by an earlier build() are unpacked again first, so adding more and building again
+        // rebuilds from all of them.
+        for (const auto& packet : packets) {
+            for (int lane = 0; lane < packet.count; lane++) {
+                auto center = point3(packet.center[0][lane], packet.center[1][lane],
+                                     packet.center[2][lane]);
+                pending.push_back({ center, double(packet.radius[lane]), packet.material[lane] });
+            }
+        }
+
+        nodes.clear();
+        packets.clear();
+        if (!pending.empty()) {
+            nodes.reserve(2 * pending.size() / simd_width + 1);
+            packets.reserve(pending.size() / simd_width + 1);
+            build(0, pending.size());
+        }
+        sphere_count = pending.size();
+        pending.clear();
+        pending.shrink_to_fit();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        vec3 inv_dir(1 / r.direction().x(), 1 / r.direction().y(), 1 / r.direction().z());
+
+        // The packet test works with a unit direction, in which t measures distance.
+        auto dir_length = r.direction().length();
+        auto unit_dir = r.direction() / dir_length;
+        const float origin[3] = {
+            float(r.origin().x()), float(r.origin().y()), float(r.origin().z()) };
+        const float dir[3] = { float(unit_dir.x()), float(unit_dir.y()), float(unit_dir.z()) };
+
+        std::uint32_t stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+
+        const sphere_packet* closest = nullptr;
+        int closest_lane = -1;
+        auto t_min = float(ray_t.min * dir_length);
+        auto closest_t = float(std::fmin(ray_t.max * dir_length, 3.0e38));
+
+        while (stack_size > 0) {
+            auto node_index = stack[--stack_size];
+            const auto& n = nodes[node_index];
+            if (!n.hit(r, inv_dir, interval(ray_t.min, closest_t / dir_length)))
+                continue;
+
+            if (n.count > 0) {
+                const auto& packet = packets[n.first];
+                int lane = intersect_packet(packet, origin, dir, t_min, closest_t);
+                if (lane >= 0) {
+                    closest = &packet;
+                    closest_lane = lane;
+                }
+                continue;
+            }
+
+            // Interior node: the right child follows directly after the left subtree.
+            stack[stack_size++] = n.first;
+            stack[stack_size++] = node_index + 1;
+        }
+
+        if (!closest)
+            return false;
+
+        rec.t = closest_t / dir_length;
+        rec.object = this;
+        rec.prim = std::uint32_t((closest - packets.data()) * simd_width + closest_lane);
+
+        return true;
+    }
+
+    void set_surface(const ray& r, hit_record& rec) const override {
+        const auto& packet = packets[rec.prim / simd_width];
+        int lane = int(rec.prim % simd_width);
+
+        auto center = point3(packet.center[0][lane], packet.center[1][lane], packet.center[2][lane]);
+        auto radius = double(packet.radius[lane]);
+
+        rec.p = r.at(rec.t);
+        vec3 outward_normal = (rec.p - center) / radius;
+        rec.set_face_normal(r, outward_normal);
+        sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+        rec.u = sphere::shift_u(rec.u, u_shift);
+        rec.mat = materials[packet.material[lane]].get();
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t size() const { return sphere_count; }
+
+    std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const override
+    {
+        if (xf.is_identity())
+            return nullptr;
+
+        auto result = std::make_shared<sphere_set>();
+        for (const auto& packet : packets) {
+            for (int lane = 0; lane < packet.count; lane++) {
+                auto center = point3(packet.center[0][lane], packet.center[1][lane],
+                                     packet.center[2][lane]);
+                result->add(xf.point(center), packet.radius[lane],
+                            materials[packet.material[lane]]);
+            }
+        }
+        result->build();
+        result->u_shift = sphere::shift_u(u_shift, -xf.angle / 360);
+        return result;
+    }
+
+  private:
+    struct sphere_data {
+        point3 center;
+        double radius;
+        std::uint32_t material;
+    };
+
+    struct sphere_packet {
+        float center[3][simd_width];         // [axis][lane]
+        float radius[simd_width];
+        std::uint32_t material[simd_width];  // Index into `materials`
+        int count;                           // Number of filled lanes
+    };
+
+    struct node {
+        float lo[3], hi[3];
+        std::uint32_t first;  // Leaf: packet index.  Interior: index of the right child.
+        std::uint32_t count;  // Leaf: sphere count.  Interior: 0 (left child is next node).
+
+        bool hit(const ray& r, const vec3& inv_dir, interval ray_t) const {
+            for (int axis = 0; axis < 3; axis++) {
+                auto t0 = (lo[axis] - r.origin()[axis]) * inv_dir[axis];
+                auto t1 = (hi[axis] - r.origin()[axis]) * inv_dir[axis];
+                if (t0 > t1) std::swap(t0, t1);
+                if (t0 > ray_t.min) ray_t.min = t0;
+                if (t1 < ray_t.max) ray_t.max = t1;
+                if (ray_t.max < ray_t.min)
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    std::vector<node> nodes;
+    std::vector<sphere_packet> packets;
+    std::vector<std::shared_ptr<material>> materials;
+    size_t sphere_count = 0;
+    aabb bbox;
+    double u_shift = 0;  // Longitude offset left by baked rotations, as in sphere
+
+    // Build-time state, released by build().
+    std::vector<sphere_data> pending;
+    std::unordered_map<const material*, std::uint32_t> material_ids;
+
+    static aabb sphere_box(const sphere_data& s) {
+        auto rvec = vec3(s.radius, s.radius, s.radius);
+        return aabb(s.center - rvec, s.center + rvec);
+    }
+
+    static int intersect_packet(
+        const sphere_packet& packet, const float origin[3], const float dir[3],
+        float t_min, float& t_max
+    ) {
+        // Intersects a unit-direction ray with every sphere of the packet. The discriminant is
+        // taken from the squared distance between the center and the ray, rather than from
+        // |oc|^2 - r^2, which keeps float precision for small spheres far from the origin.
+        // Returns the lane of the closest hit in (t_min, t_max), narrowing t_max to it, or -1.
+
+        vfloat oc[3];
+        for (int axis = 0; axis < 3; axis++)
+            oc[axis] = vfloat::load(packet.center[axis]) - vfloat(origin[axis]);
+
+        auto b = oc[0]*vfloat(dir[0]) + oc[1]*vfloat(dir[1]) + oc[2]*vfloat(dir[2]);
+
+        vfloat f[3];
+        for (int axis = 0; axis < 3; axis++)
+            f[axis] = oc[axis] - b*vfloat(dir[axis]);
+
+        auto radius = vfloat::load(packet.radius);
+        auto discriminant = radius*radius - (f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+
+        const vfloat zero(0.0f);
+        auto valid = andnot(lane_mask(packet.count), discriminant < zero);
+        if (!valid.any())
+            return -1;
+
+        auto sqrtd = sqrt(select(valid, discriminant, zero));
+
+        // Take the nearest root in range, falling back to the far one from inside a sphere.
+        auto near_root = b - sqrtd;
+        auto far_root  = b + sqrtd;
+        auto t = select(near_root > vfloat(t_min), near_root, far_root);
+        valid = valid & (t > vfloat(t_min)) & (t < vfloat(t_max));
+
+        if (!valid.any())
+            return -1;
+
+        return closest_lane(valid, t, t_max);
+    }
+
+    static float round_down(double x) {
+        auto f = float(x);
+        return (double(f) > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+    }
+
+    static float round_up(double x) {
+        auto f = float(x);
+        return (double(f) < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+
+    void build(size_t start, size_t end) {
+        // Builds the subtree for pending[start, end) in depth-first order: an interior node is
+        // immediately followed by its left subtree, and stores the index of its right child.
+
+        aabb box, centroid_box;
+        for (size_t i = start; i < end; i++) {
+            box = aabb(box, sphere_box(pending[i]));
+            centroid_box = aabb(centroid_box, aabb(pending[i].center, pending[i].center));
+        }
+
+        auto node_index = nodes.size();
+        nodes.emplace_back();
+        for (int axis = 0; axis < 3; axis++) {
+            nodes[node_index].lo[axis] = round_down(box.axis_interval(axis).min);
+            nodes[node_index].hi[axis] = round_up(box.axis_interval(axis).max);
+        }
+
+        size_t span = end - start;
+        if (span <= size_t(simd_width)) {
+            nodes[node_index].first = std::uint32_t(packets.size());
+            nodes[node_index].count = std::uint32_t(span);
+            packets.push_back(make_packet(start, end));
+            return;
+        }
+
+        int axis = centroid_box.longest_axis();
+        auto mid = start + span/2;
+        std::nth_element(std::begin(pending) + start, std::begin(pending) + mid,
+            std::begin(pending) + end,
+            [axis](const sphere_data& a, const sphere_data& b) {
+                return a.center[axis] < b.center[axis];
+            });
+
+        build(start, mid);
+        nodes[node_index].first = std::uint32_t(nodes.size());
+        nodes[node_index].count = 0;
+        build(mid, end);
+    }
+
+    sphere_packet make_packet(size_t start, size_t end) const {
+        // Transposes up to simd_width spheres into SoA layout; unused lanes repeat the last
+        // sphere and are masked off by `count` during intersection.
+        sphere_packet packet;
+        packet.count = int(end - start);
+        for (int lane = 0; lane < simd_width; lane++) {
+            const auto& s = pending[std::min(start + lane, end - 1)];
+            for (int axis = 0; axis < 3; axis++)
+                packet.center[axis][lane] = float(s.center[axis]);
+            packet.radius[lane] = float(s.radius);
+            packet.material[lane] = s.material;
+        }
+        return packet;
+    }
+};
+
+#endif
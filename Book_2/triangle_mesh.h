@@ -0,0 +1,365 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "ray.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+
+// Indexed triangle mesh. Vertex attributes are stored once in shared float buffers and each
+// triangle is referenced by its index in `indices`, so a mesh costs one hittable (and one
+// material reference) no matter how many triangles it has. The mesh carries its own flattened
+// BVH over those triangle indices and exposes a single bounding box to the scene's bvh_node.
+// Each BVH leaf packs up to `simd_width` triangles in SoA layout, gathered from the vertex
+// buffer when the BVH is built, and all of them are tested against the ray at once.
+class triangle_mesh : public hittable {
+  public:
+    static constexpr int max_leaf_size = simd_width;
+
+    // positions: x,y,z per vertex.  indices: three vertex indices per triangle.
+    // normals (optional): x,y,z per vertex.  uvs (optional): u,v per vertex.
+    triangle_mesh(
+        std::vector<float> positions, std::vector<std::uint32_t> indices,
+        std::shared_ptr<material> mat,
+        std::vector<float> normals = {}, std::vector<float> uvs = {}
+    ) : positions(std::move(positions)), indices(std::move(indices)),
+        normals(std::move(normals)), uvs(std::move(uvs)), mat(mat)
+    {
+        auto triangle_count = this->indices.size() / 3;
+        std::vector<tri_data> tris(triangle_count);
+
+        for (size_t i = 0; i < triangle_count; i++) {
+            auto p0 = corner(i, 0), p1 = corner(i, 1), p2 = corner(i, 2);
+            tris[i].centroid = (p0 + p1 + p2) / 3;
+            tris[i].prim = std::uint32_t(i);
+
+            bbox = aabb(bbox, aabb(aabb(p0, p1), aabb(p2, p2)));
+        }
+
+        if (!tris.empty()) {
+            nodes.reserve(2 * triangle_count / max_leaf_size + 1);
+            packets.reserve(triangle_count / max_leaf_size + 1);
+            build(tris, 0, tris.size());
+        }
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        vec3 inv_dir(1 / r.direction().x(), 1 / r.direction().y(), 1 / r.direction().z());
+        ray_setup setup(r);
+
+        std::uint32_t stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+
+        const tri_packet* closest = nullptr;
+        int closest_lane = -1;
+        float closest_t = float(ray_t.max);
+        double closest_b1 = 0, closest_b2 = 0;
+
+        while (stack_size > 0) {
+            auto node_index = stack[--stack_size];
+            const auto& n = nodes[node_index];
+            if (!n.hit(r, inv_dir, interval(ray_t.min, closest_t)))
+                continue;
+
+            if (n.count > 0) {
+                const auto& packet = packets[n.first];
+                double b1, b2;
+                int lane = intersect_packet(packet, setup, float(ray_t.min), closest_t, b1, b2);
+                if (lane >= 0) {
+                    closest = &packet;
+                    closest_lane = lane;
+                    closest_b1 = b1;
+                    closest_b2 = b2;
+                }
+                continue;
+            }
+
+            // Interior node: the right child follows directly after the left subtree.
+            stack[stack_size++] = n.first;
+            stack[stack_size++] = node_index + 1;
+        }
+
+        if (!closest)
+            return false;
+
+        // Surface attributes are left to set_surface(); keep the packet lane and barycentrics.
+        rec.t = closest_t;
+        rec.object = this;
+        rec.prim = std::uint32_t((closest - packets.data()) * simd_width + closest_lane);
+        rec.u = closest_b1;
+        rec.v = closest_b2;
+
+        return true;
+    }
+
+    void set_surface(const ray& r, hit_record& rec) const override {
+        const auto& packet = packets[rec.prim / simd_width];
+        int lane = int(rec.prim % simd_width);
+        auto b1 = rec.u, b2 = rec.v;
+        auto b0 = 1 - b1 - b2;
+
+        auto prim = packet.prim[lane];
+        auto i0 = indices[3*prim], i1 = indices[3*prim + 1], i2 = indices[3*prim + 2];
+
+        rec.p = r.at(rec.t);
+        rec.mat = mat.get();
+
+        auto p0 = vertex(positions, i0);
+        auto geometric_normal = unit_vector(
+            cross(vertex(positions, i1) - p0, vertex(positions, i2) - p0));
+        rec.set_face_normal(r, geometric_normal);
+
+        if (!normals.empty()) {
+            // Shade with the interpolated vertex normal, oriented to the same side as the
+            // geometric one so front_face stays consistent.
+            auto shading_normal = unit_vector(
+                b0*vertex(normals, i0) + b1*vertex(normals, i1) + b2*vertex(normals, i2));
+            rec.normal = rec.front_face ? shading_normal : -shading_normal;
+        }
+
+        if (!uvs.empty()) {
+            rec.u = b0*uvs[2*i0]     + b1*uvs[2*i1]     + b2*uvs[2*i2];
+            rec.v = b0*uvs[2*i0 + 1] + b1*uvs[2*i1 + 1] + b2*uvs[2*i2 + 1];
+        }
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    std::shared_ptr<hittable> transformed(
+        const rigid_transform& xf, const instance_counts& counts) const override
+    {
+        if (xf.is_identity())
+            return nullptr;
+
+        auto new_positions = positions;
+        for (size_t i = 0; i < new_positions.size() / 3; i++) {
+            auto p = xf.point(vertex(positions, std::uint32_t(i)));
+            for (int axis = 0; axis < 3; axis++)
+                new_positions[3*i + axis] = float(p[axis]);
+        }
+
+        auto new_normals = normals;
+        for (size_t i = 0; i < new_normals.size() / 3; i++) {
+            auto n = xf.vector(vertex(normals, std::uint32_t(i)));
+            for (int axis = 0; axis < 3; axis++)
+                new_normals[3*i + axis] = float(n[axis]);
+        }
+
+        return std::make_shared<triangle_mesh>(
+            std::move(new_positions), indices, mat, std::move(new_normals), uvs);
+    }
+
+  private:
+    struct tri_data {
+        point3 centroid;
+        std::uint32_t prim;   // Index of the triangle in `indices`
+    };
+
+    struct tri_packet {
+        // Copy of the lanes' vertices from `positions`, so the SIMD test loads whole lanes
+        // instead of gathering through the indices.
+        float v[3][3][simd_width];           // [vertex][axis][lane]
+        std::uint32_t prim[simd_width];      // Triangle index per lane
+        int count;                           // Number of filled lanes
+    };
+
+    struct node {
+        float lo[3], hi[3];
+        std::uint32_t first;  // Leaf: packet index.  Interior: index of the right child.
+        std::uint32_t count;  // Leaf: triangle count.  Interior: 0 (left child is next node).
+
+        bool hit(const ray& r, const vec3& inv_dir, interval ray_t) const {
+            for (int axis = 0; axis < 3; axis++) {
+                auto t0 = (lo[axis] - r.origin()[axis]) * inv_dir[axis];
+                auto t1 = (hi[axis] - r.origin()[axis]) * inv_dir[axis];
+                if (t0 > t1) std::swap(t0, t1);
+                if (t0 > ray_t.min) ray_t.min = t0;
+                if (t1 < ray_t.max) ray_t.max = t1;
+                if (ray_t.max < ray_t.min)
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    struct ray_setup {
+        // Per-ray constants of the watertight test (Woop, Benthin & Wald 2013): the axes are
+        // permuted so the dominant direction component becomes z, and the ray is sheared onto
+        // the +z axis.
+        int kx, ky, kz;
+        float sx, sy, sz;
+        float origin[3];
+
+        ray_setup(const ray& r) {
+            const auto& d = r.direction();
+            kz = (std::fabs(d.x()) > std::fabs(d.y()))
+               ? (std::fabs(d.x()) > std::fabs(d.z()) ? 0 : 2)
+               : (std::fabs(d.y()) > std::fabs(d.z()) ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            if (d[kz] < 0) std::swap(kx, ky);
+
+            sx = float(d[kx] / d[kz]);
+            sy = float(d[ky] / d[kz]);
+            sz = float(1.0 / d[kz]);
+
+            for (int axis = 0; axis < 3; axis++)
+                origin[axis] = float(r.origin()[axis]);
+        }
+    };
+
+    std::vector<node> nodes;
+    std::vector<tri_packet> packets;
+    std::vector<float> positions;
+    std::vector<std::uint32_t> indices;
+    std::vector<float> normals;
+    std::vector<float> uvs;
+    std::shared_ptr<material> mat;
+    aabb bbox;
+
+    static vec3 vertex(const std::vector<float>& buffer, std::uint32_t i) {
+        return vec3(buffer[3*i], buffer[3*i + 1], buffer[3*i + 2]);
+    }
+
+    point3 corner(size_t prim, int k) const {
+        return vertex(positions, indices[3*prim + k]);
+    }
+
+    static int intersect_packet(
+        const tri_packet& packet, const ray_setup& s, float t_min, float& t_max,
+        double& b1, double& b2
+    ) {
+        // Watertight ray/triangle test against every lane of the packet. Edge functions are
+        // evaluated from the shared vertices in the same sheared frame, so adjacent triangles
+        // can never both miss a ray through their common edge. Returns the lane of the closest
+        // hit in (t_min, t_max), narrowing t_max to it, or -1.
+
+        vfloat a[3], b[3], c[3];
+        vfloat* out[3] = { a, b, c };
+
+        for (int k = 0; k < 3; k++) {
+            auto z = vfloat::load(packet.v[k][s.kz]) - vfloat(s.origin[s.kz]);
+            out[k][0] = vfloat::load(packet.v[k][s.kx]) - vfloat(s.origin[s.kx]) - vfloat(s.sx) * z;
+            out[k][1] = vfloat::load(packet.v[k][s.ky]) - vfloat(s.origin[s.ky]) - vfloat(s.sy) * z;
+            out[k][2] = vfloat(s.sz) * z;
+        }
+
+        auto u = c[0]*b[1] - c[1]*b[0];
+        auto v = a[0]*c[1] - a[1]*c[0];
+        auto w = b[0]*a[1] - b[1]*a[0];
+
+        const vfloat zero(0.0f);
+        auto valid = lane_mask(packet.count);
+        valid = andnot(valid, ((u < zero) | (v < zero) | (w < zero))
+                            & ((u > zero) | (v > zero) | (w > zero)));
+
+        auto det = u + v + w;
+        valid = valid & (det != zero);
+
+        auto t = (u*a[2] + v*b[2] + w*c[2]) / det;
+        valid = valid & (t > vfloat(t_min)) & (t < vfloat(t_max));
+
+        if (!valid.any())
+            return -1;
+
+        int lane = closest_lane(valid, t, t_max);
+
+        float us[simd_width], vs[simd_width], ws[simd_width];
+        u.store(us);
+        v.store(vs);
+        w.store(ws);
+        double sum = double(us[lane]) + vs[lane] + ws[lane];
+        b1 = vs[lane] / sum;
+        b2 = ws[lane] / sum;
+
+        return lane;
+    }
+
+    static float round_down(double x) {
+        auto f = float(x);
+        return (double(f) > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+    }
+
+    static float round_up(double x) {
+        auto f = float(x);
+        return (double(f) < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+
+    void build(std::vector<tri_data>& tris, size_t start, size_t end) {
+        // Builds the subtree for tris[start, end) in depth-first order: an interior node is
+        // immediately followed by its left subtree, and stores the index of its right child.
+
+        aabb box, centroid_box;
+        for (size_t i = start; i < end; i++) {
+            auto p0 = corner(tris[i].prim, 0);
+            auto p1 = corner(tris[i].prim, 1);
+            auto p2 = corner(tris[i].prim, 2);
+            box = aabb(box, aabb(aabb(p0, p1), aabb(p2, p2)));
+            const auto& c = tris[i].centroid;
+            centroid_box = aabb(centroid_box, aabb(c, c));
+        }
+
+        auto node_index = nodes.size();
+        nodes.emplace_back();
+        for (int axis = 0; axis < 3; axis++) {
+            nodes[node_index].lo[axis] = round_down(box.axis_interval(axis).min);
+            nodes[node_index].hi[axis] = round_up(box.axis_interval(axis).max);
+        }
+
+        size_t span = end - start;
+        if (span <= size_t(max_leaf_size)) {
+            nodes[node_index].first = std::uint32_t(packets.size());
+            nodes[node_index].count = std::uint32_t(span);
+            packets.push_back(make_packet(tris, start, end));
+            return;
+        }
+
+        int axis = centroid_box.longest_axis();
+        auto mid = start + span/2;
+        std::nth_element(std::begin(tris) + start, std::begin(tris) + mid, std::begin(tris) + end,
+            [axis](const tri_data& a, const tri_data& b) {
+                return a.centroid[axis] < b.centroid[axis];
+            });
+
+        build(tris, start, mid);
+        nodes[node_index].first = std::uint32_t(nodes.size());
+        nodes[node_index].count = 0;
+        build(tris, mid, end);
+    }
+
+    tri_packet make_packet(const std::vector<tri_data>& tris, size_t start, size_t end) const {
+        // Transposes up to simd_width triangles from the vertex buffer into SoA layout; unused
+        // lanes repeat the last triangle and are masked off by `count` during intersection.
+        tri_packet packet;
+        packet.count = int(end - start);
+        for (int lane = 0; lane < simd_width; lane++) {
+            auto prim = tris[std::min(start + lane, end - 1)].prim;
+            for (int k = 0; k < 3; k++)
+                for (int axis = 0; axis < 3; axis++)
+                    packet.v[k][axis][lane] = positions[3*indices[3*prim + k] + axis];
+            packet.prim[lane] = prim;
+        }
+        return packet;
+    }
+};
+
+#endif
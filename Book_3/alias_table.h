@@ -0,0 +1,87 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include "rtweekend.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+class alias_table {
+  // Discrete distribution over n outcomes with O(1) sampling (Walker's alias method, built with
+  // Vose's algorithm). Each of the n equally likely bins holds an outcome, a threshold, and an
+  // alias outcome taken when a uniform draw lands above the threshold.
+  public:
+    alias_table() {}
+
+    alias_table(const std::vector<double>& weights) {
+        auto n = weights.size();
+        bins.resize(n);
+        pmfs.resize(n);
+
+        total_weight = 0;
+        for (auto w : weights)
+            total_weight += (w > 0) ? w : 0;
+
+        if (n == 0 || total_weight <= 0) {
+            // Nothing has any weight: fall back to a uniform choice.
+            for (size_t i = 0; i < n; i++) {
+                bins[i] = { 1.0, std::uint32_t(i) };
+                pmfs[i] = 1.0 / n;
+            }
+            return;
+        }
+
+        // Scale the weights so the average is 1, then pair each under-full bin with an over-full
+        // one that donates the rest of its probability mass.
+        std::vector<double> scaled(n);
+        std::vector<std::uint32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            pmfs[i] = ((weights[i] > 0) ? weights[i] : 0) / total_weight;
+            scaled[i] = pmfs[i] * n;
+            (scaled[i] < 1 ? small : large).push_back(std::uint32_t(i));
+        }
+
+        while (!small.empty() && !large.empty()) {
+            auto s = small.back(); small.pop_back();
+            auto l = large.back(); large.pop_back();
+
+            bins[s] = { scaled[s], l };
+            scaled[l] -= 1 - scaled[s];
+            (scaled[l] < 1 ? small : large).push_back(l);
+        }
+
+        // Whatever is left is (up to rounding) exactly full.
+        for (auto i : large) bins[i] = { 1.0, i };
+        for (auto i : small) bins[i] = { 1.0, i };
+    }
+
+    size_t size() const { return bins.size(); }
+
+    double total() const { return total_weight; }
+
+    double pmf(size_t index) const { return pmfs[index]; }
+
+    size_t sample(double u) const {
+        // Maps a uniform u in [0,1) to an outcome: the integer part picks the bin, and the
+        // fractional part decides between the bin's own outcome and its alias.
+        auto scaled = u * bins.size();
+        auto index = std::min(size_t(scaled), bins.size() - 1);
+        auto fraction = scaled - index;
+        return (fraction < bins[index].threshold) ? index : bins[index].alias;
+    }
+
+    size_t sample() const { return sample(random_double()); }
+
+  private:
+    struct bin {
+        double threshold;
+        std::uint32_t alias;
+    };
+
+    std::vector<bin> bins;
+    std::vector<double> pmfs;
+    double total_weight = 0;
+};
+
+#endif
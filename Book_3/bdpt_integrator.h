@@ -0,0 +1,420 @@
+#ifndef BDPT_INTEGRATOR_H
+#define BDPT_INTEGRATOR_H
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "path_tracer.h"
+#include "onb.h"
+#include "sampler.h"
+#include <atomic>
+#include <vector>
+
+
+class bdpt_integrator {
+  // integrator_type::bdpt: bidirectional path tracing. A camera and a light subpath are joined
+  // at every pair of vertices and all strategies combined with the power heuristic;
+  // connections to the camera itself are splatted onto the image.
+  public:
+    bdpt_integrator(const camera& cam, const path_tracer& tracer) : cam(cam), tracer(tracer) {}
+
+    void render(
+        const hittable& world, const hittable& lights,
+        std::vector<std::vector<color>>& pixel_buffer
+    ) const {
+        // Every camera sample also traces a light subpath. Connections that end on the camera
+        // land on any pixel, so they add into a shared splat image.
+        std::vector<color> splats(cam.image_width * cam.image_height, color(0,0,0));
+        std::atomic<bool> unsampled(false);
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int j = 0; j < cam.image_height; j++) {
+            std::vector<bdpt_vertex> camera_path, light_path;
+            pixel_sampler numbers(cam.sampler, cam.sqrt_spp * cam.sqrt_spp);
+            for (int i = 0; i < cam.image_width; i++) {
+                color pixel_color(0,0,0);
+                for (int s_j = 0; s_j < cam.sqrt_spp; s_j++) {
+                    for (int s_i = 0; s_i < cam.sqrt_spp; s_i++) {
+                        sample_source_scope scope(
+                            cam.start_camera_sample(numbers, i, j, s_j*cam.sqrt_spp + s_i));
+                        ray r = cam.get_ray(i, j, s_i, s_j);
+                        pixel_color += bdpt_sample(r, world, lights, camera_path, light_path,
+                                                   splats, unsampled);
+                    }
+                }
+                pixel_buffer[j][i] = cam.pixel_samples_scale * pixel_color;
+            }
+            // Only one thread should update the progress bar
+            #pragma omp critical
+            std::clog << "\rScanlines remaining: " << (cam.image_height - j) << ' ' << std::flush;
+        }
+
+        for (int j = 0; j < cam.image_height; j++)
+            for (int i = 0; i < cam.image_width; i++)
+                pixel_buffer[j][i] += cam.pixel_samples_scale * splats[j*cam.image_width + i];
+
+        if (unsampled) {
+            std::cerr << "WARNING: bdpt needs lights that can be sampled by area and carry their "
+                         "emissive material; light subpaths were skipped.\n";
+        }
+    }
+
+  private:
+    const camera& cam;
+    const path_tracer& tracer;
+
+    struct bdpt_vertex {
+        // Vertex of a camera or light subpath. Densities are over area (or volume, inside a
+        // medium) and left at zero around specular vertices, whose scattering cannot be
+        // evaluated.
+        enum class kind { camera, light, surface };
+
+        kind type = kind::surface;
+        hit_record rec;       // Point & normal; for a light, the outward normal and material
+        ray r_in;             // Surface: the ray that reached the vertex
+        color beta;           // Throughput of the subpath up to the vertex, over its density
+        color attenuation;    // Surface: material attenuation for r_in
+        double pdf_fwd = 0;   // Density of the vertex from the previous one of its subpath
+        double pdf_rev = 0;   // Density from the next one, had the subpath been traced the
+                              // other way
+        bool delta = false;   // Specular scattering
+        bool scatters = false;    // Non-specular scattering: can be connected to
+        bool reciprocal = true;   // A light subpath may pass through (see forms_caustics)
+
+        bool on_surface() const {
+            return type != kind::camera
+                && !(type == kind::surface && rec.mat->kind() == material_kind::isotropic);
+        }
+    };
+
+
+    color bdpt_sample(
+        const ray& r, const hittable& world, const hittable& lights,
+        std::vector<bdpt_vertex>& camera_path, std::vector<bdpt_vertex>& light_path,
+        std::vector<color>& splats, std::atomic<bool>& unsampled
+    ) const {
+        // Radiance of one camera sample: every strategy (s light vertices, t camera vertices)
+        // of every path length up to max_depth segments, weighted by MIS.
+        camera_path.clear();
+        light_path.clear();
+
+        bdpt_vertex camera_vertex;
+        camera_vertex.type = bdpt_vertex::kind::camera;
+        camera_vertex.rec.p = r.origin();
+        camera_vertex.rec.normal = -cam.w;
+        camera_vertex.beta = color(1,1,1);
+        camera_path.push_back(camera_vertex);
+        auto camera_pdf = cam.camera_direction_pdf(r.origin(), unit_vector(r.direction()));
+        color escaped = bdpt_walk(r, color(1,1,1), camera_pdf, cam.max_depth + 1, false, world,
+                                  camera_path);
+
+        surface_sample emission;
+        if (lights.sample_surface(emission) && emission.mat && emission.pdf > 0) {
+            bdpt_vertex light_vertex;
+            light_vertex.type = bdpt_vertex::kind::light;
+            light_vertex.rec.p = emission.p;
+            light_vertex.rec.normal = emission.normal;
+            light_vertex.rec.u = emission.u;
+            light_vertex.rec.v = emission.v;
+            light_vertex.rec.mat = emission.mat;
+            light_vertex.rec.front_face = true;
+            light_vertex.beta = color(1,1,1) / emission.pdf;
+            light_vertex.pdf_fwd = emission.pdf;
+            light_path.push_back(light_vertex);
+
+            // Cosine-distributed emission: Le cos / (pdf * cos/pi).
+            onb uvw(emission.normal);
+            ray emitted_ray(emission.p, uvw.transform(random_cosine_direction()), r.time());
+            auto cosine = dot(emission.normal, unit_vector(emitted_ray.direction()));
+            color beta = light_emission(light_vertex, emitted_ray.direction()) * pi / emission.pdf;
+            if (cosine > 0 && !beta.near_zero())
+                bdpt_walk(emitted_ray, beta, cosine / pi, cam.max_depth, true, world, light_path);
+        } else if (!tracer.environment) {
+            unsampled = true;  // The environment has no surface to start a light subpath from
+        }
+
+        // Camera paths that leave the scene see the background; no other strategy does.
+        color radiance = escaped;
+
+        for (int t = 1; t <= int(camera_path.size()); t++) {
+            for (int s = 0; s <= int(light_path.size()); s++) {
+                // A light seen directly is left to the camera path (s = 0) alone.
+                if (s + t - 1 > cam.max_depth || (t == 1 && s < 2))
+                    continue;
+
+                if (t == 1) {
+                    bdpt_splat(s, world, lights, light_path, r.time(), splats);
+                    continue;
+                }
+
+                const auto& pt = camera_path[t-1];
+                color contribution;
+                if (s == 0) {
+                    if (pt.type != bdpt_vertex::kind::surface)
+                        continue;
+                    contribution = pt.beta * emitted(*pt.rec.mat, pt.r_in, pt.rec);
+                } else {
+                    const auto& qs = light_path[s-1];
+                    if (!pt.scatters || !(qs.scatters || qs.type == bdpt_vertex::kind::light))
+                        continue;
+
+                    auto to_light = qs.rec.p - pt.rec.p;
+                    auto distance_squared = to_light.length_squared();
+                    if (distance_squared <= 0)
+                        continue;
+                    contribution = pt.beta * vertex_f(pt, to_light) * vertex_f(qs, -to_light)
+                                 * qs.beta / distance_squared;
+                    if (contribution.near_zero())
+                        continue;
+
+                    hit_record blocker;
+                    ray shadow(pt.rec.p, to_light, r.time());
+                    if (world.hit(shadow, interval(0.001, 0.999), blocker))
+                        continue;
+                }
+
+                if (!contribution.near_zero())
+                    radiance += contribution
+                              * bdpt_weight(camera_path, light_path, s, t, nullptr, lights);
+            }
+        }
+
+        return radiance;
+    }
+
+    color bdpt_walk(
+        ray r, color beta, double pdf_dir, int max_vertices, bool from_light,
+        const hittable& world, std::vector<bdpt_vertex>& path
+    ) const {
+        // Extends a subpath holding its endpoint by sampling the materials it meets, up to
+        // `max_vertices` vertices in all, ending paths of low throughput by Russian roulette.
+        // `pdf_dir` is the density of `r` at the endpoint. Returns the throughput times the
+        // background of a ray that left the scene, zero if none did.
+        while (int(path.size()) < max_vertices) {
+            hit_record rec;
+            if (!world.hit(r, interval(0.001, infinity), rec))
+                return beta * tracer.escaped_radiance(r);
+
+            bdpt_vertex vertex;
+            vertex.rec = rec;
+            vertex.r_in = r;
+            vertex.beta = beta;
+            vertex.pdf_fwd = convert_density(pdf_dir, path.back(), vertex);
+
+            scatter_record srec;
+            bool scattered = scatter(*rec.mat, r, rec, srec);
+            if (scattered) {
+                vertex.attenuation = srec.attenuation;
+                vertex.delta = srec.skip_pdf;
+                vertex.scatters = !srec.skip_pdf;
+                vertex.reciprocal = !srec.skip_pdf || tracer.forms_caustics(*rec.mat);
+            }
+            path.push_back(vertex);
+
+            if (!scattered || int(path.size()) >= max_vertices)
+                break;
+            auto& current = path.back();
+            auto& previous = path[path.size() - 2];
+
+            if (srec.skip_pdf) {
+                if (from_light && !current.reciprocal)
+                    break;
+                beta = beta * srec.attenuation;
+                pdf_dir = 0;
+                previous.pdf_rev = 0;
+                r = srec.skip_pdf_ray;
+                continue;
+            }
+
+            ray next(rec.p, srec.pdf_ptr->generate(), r.time());
+            pdf_dir = srec.pdf_ptr->value(next.direction());
+            color f = srec.attenuation * scattering_pdf(*rec.mat, r, rec, next);
+            if (pdf_dir <= 0 || f.near_zero())
+                break;
+
+            previous.pdf_rev =
+                convert_density(srec.pdf_ptr->value(-r.direction()), current, previous);
+            color throughput = f / pdf_dir;
+            beta = beta * throughput;
+            r = next;
+
+            if (path.size() > 3) {
+                auto survival = std::fmin(1.0, std::fmax(throughput.x(),
+                                          std::fmax(throughput.y(), throughput.z())));
+                if (random_double() >= survival)
+                    break;
+                beta /= survival;
+            }
+        }
+
+        return color(0,0,0);
+    }
+
+    void bdpt_splat(
+        int s, const hittable& world, const hittable& lights,
+        const std::vector<bdpt_vertex>& light_path, double time, std::vector<color>& splats
+    ) const {
+        // Strategy t = 1: connects the end of a light subpath to a point on the lens, adding to
+        // the pixel the connection crosses. With the importance of a pixel normalized over the
+        // whole film, the sum of the splats over all samples of a pixel estimates its value.
+        const auto& qs = light_path[s-1];
+        if (!qs.scatters && qs.type != bdpt_vertex::kind::light)
+            return;
+
+        bdpt_vertex lens;
+        lens.type = bdpt_vertex::kind::camera;
+        lens.rec.p = (cam.defocus_angle <= 0) ? cam.center : cam.defocus_disk_sample();
+        lens.rec.normal = -cam.w;
+
+        auto to_camera = lens.rec.p - qs.rec.p;
+        auto distance_squared = to_camera.length_squared();
+        int x, y;
+        if (distance_squared <= 0 || !cam.raster_position(lens.rec.p, -to_camera, x, y))
+            return;
+
+        auto cosine = dot(unit_vector(-to_camera), -cam.w);
+        color contribution = qs.beta * vertex_f(qs, to_camera)
+                           / (cam.film_area * cosine * cosine * cosine * distance_squared);
+        if (contribution.near_zero())
+            return;
+
+        hit_record blocker;
+        if (world.hit(ray(qs.rec.p, to_camera, time), interval(0.001, 0.999), blocker))
+            return;
+
+        static const std::vector<bdpt_vertex> no_camera_path;
+        contribution = contribution * bdpt_weight(no_camera_path, light_path, s, 1, &lens, lights);
+
+        cam.add_splat(splats, x, y, contribution);
+    }
+
+    double bdpt_weight(
+        const std::vector<bdpt_vertex>& camera_path, const std::vector<bdpt_vertex>& light_path,
+        int s, int t, const bdpt_vertex* lens, const hittable& lights
+    ) const {
+        // Power-heuristic weight of strategy (s, t) (Veach 1997, as laid out in pbrt): walks
+        // from the connection towards each end, turning the density of the path under this
+        // strategy into that under every other through ratios of reverse to forward densities.
+        // Only the densities around the connection change, so they are recomputed here.
+        if (s + t == 2)
+            return 1;
+
+        const bdpt_vertex& pt = (t == 1) ? *lens : camera_path[t-1];
+        const bdpt_vertex* pt_minus = (t > 1) ? &camera_path[t-2] : nullptr;
+        const bdpt_vertex* qs = (s > 0) ? &light_path[s-1] : nullptr;
+        const bdpt_vertex* qs_minus = (s > 1) ? &light_path[s-2] : nullptr;
+
+        double pt_rev, pt_minus_rev = 0, qs_rev = 0, qs_minus_rev = 0;
+        if (s > 0) {
+            pt_rev = vertex_pdf(*qs, pt);
+            if (pt_minus)
+                pt_minus_rev = vertex_pdf(pt, *pt_minus);
+            qs_rev = vertex_pdf(pt, *qs);
+            if (qs_minus)
+                qs_minus_rev = vertex_pdf(*qs, *qs_minus);
+        } else {
+            // The camera path hit an emitter: how a light subpath would have started there.
+            pt_rev = lights.surface_pdf(pt.rec.p);
+            if (pt_rev <= 0)
+                return 1;  // Not among the lights; no other strategy can find this path
+            bdpt_vertex as_light = pt;
+            as_light.type = bdpt_vertex::kind::light;
+            if (!pt.rec.front_face)
+                as_light.rec.normal = -pt.rec.normal;
+            pt_minus_rev = vertex_pdf(as_light, *pt_minus);
+        }
+
+        auto camera_rev = [&](int i) {
+            return (i == t-1) ? pt_rev : (i == t-2) ? pt_minus_rev : camera_path[i].pdf_rev;
+        };
+        auto light_rev = [&](int i) {
+            return (i == s-1) ? qs_rev : (i == s-2) ? qs_minus_rev : light_path[i].pdf_rev;
+        };
+        auto ratio = [](double numerator, double denominator) {
+            // Zero densities belong to specular vertices, which cancel out.
+            auto r = (numerator != 0 ? numerator : 1) / (denominator != 0 ? denominator : 1);
+            return r * r;
+        };
+
+        // Strategies with fewer camera vertices. Light subpaths cannot pass through vertices
+        // that are not reciprocal, which rules out the rest once one is reached.
+        double sum = 0, r = 1;
+        for (int i = t - 1; i > 0; i--) {
+            if (i + 1 <= t - 1 && !camera_path[i+1].reciprocal)
+                break;
+            r *= ratio(camera_rev(i), camera_path[i].pdf_fwd);
+            bool delta = (i != t-1 && camera_path[i].delta) || camera_path[i-1].delta;
+            if (!delta)
+                sum += r;
+        }
+
+        // Strategies with fewer light vertices.
+        r = 1;
+        for (int i = s - 1; i >= 0; i--) {
+            r *= ratio(light_rev(i), light_path[i].pdf_fwd);
+            bool delta = (i != s-1 && light_path[i].delta) || (i > 0 && light_path[i-1].delta);
+            if (!delta)
+                sum += r;
+        }
+
+        return 1 / (1 + sum);
+    }
+
+    double vertex_pdf(const bdpt_vertex& from, const bdpt_vertex& to) const {
+        // Density over area with which `from` samples `to`, by its camera, emission or material.
+        auto direction = to.rec.p - from.rec.p;
+        if (direction.length_squared() <= 0)
+            return 0;
+        direction = unit_vector(direction);
+
+        double pdf_dir;
+        if (from.type == bdpt_vertex::kind::camera)
+            pdf_dir = cam.camera_direction_pdf(from.rec.p, direction);
+        else if (from.type == bdpt_vertex::kind::light)
+            pdf_dir = std::fmax(0, dot(from.rec.normal, direction)) / pi;
+        else
+            pdf_dir = scatter_pdf(from, direction);
+
+        return convert_density(pdf_dir, from, to);
+    }
+
+    static double convert_density(double pdf_dir, const bdpt_vertex& from, const bdpt_vertex& to) {
+        // Density over solid angle at `from` to density over area at `to`.
+        auto offset = to.rec.p - from.rec.p;
+        auto distance_squared = offset.length_squared();
+        if (distance_squared <= 0)
+            return 0;
+        if (to.on_surface())
+            pdf_dir *= std::fabs(dot(to.rec.normal, offset)) / std::sqrt(distance_squared);
+        return pdf_dir / distance_squared;
+    }
+
+    double scatter_pdf(const bdpt_vertex& vertex, const vec3& direction) const {
+        // Density of the material's sampling at a surface vertex. The materials here sample
+        // around the normal alone, so the same holds whichever neighbour the light comes from.
+        scatter_record srec;
+        if (!scatter(*vertex.rec.mat, vertex.r_in, vertex.rec, srec) || srec.skip_pdf)
+            return 0;
+        return srec.pdf_ptr->value(direction);
+    }
+
+    color vertex_f(const bdpt_vertex& vertex, const vec3& direction) const {
+        // What a connection endpoint sends along `direction`, per unit throughput and including
+        // its cosine: the material's f cos, or a light's emitted radiance times cos.
+        if (vertex.type == bdpt_vertex::kind::light) {
+            auto cosine = dot(vertex.rec.normal, unit_vector(direction));
+            if (cosine <= 0)
+                return color(0,0,0);
+            return light_emission(vertex, direction) * cosine;
+        }
+        if (!vertex.scatters)
+            return color(0,0,0);
+        ray out(vertex.rec.p, direction, vertex.r_in.time());
+        return vertex.attenuation * scattering_pdf(*vertex.rec.mat, vertex.r_in, vertex.rec, out);
+    }
+
+    static color light_emission(const bdpt_vertex& light, const vec3& direction) {
+        return emitted(*light.rec.mat, ray(light.rec.p + direction, -direction), light.rec);
+    }
+};
+
+#endif
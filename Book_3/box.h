@@ -0,0 +1,218 @@
+#ifndef BOX_H
+#define BOX_H
+
+#include "hittable.h"
+#include "aabb.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+
+class box : public hittable {
+  public:
+    box(const point3& a, const point3& b, std::shared_ptr<material> mat) : mat(mat) {
+        // The box spans the two opposite vertices a & b, in any coordinate order.
+        min_corner = point3(std::fmin(a.x(),b.x()), std::fmin(a.y(),b.y()), std::fmin(a.z(),b.z()));
+        max_corner = point3(std::fmax(a.x(),b.x()), std::fmax(a.y(),b.y()), std::fmax(a.z(),b.z()));
+        bbox = aabb(min_corner, max_corner);
+
+        auto size = max_corner - min_corner;
+        for (int axis = 0; axis < 3; axis++)
+            face_area[axis] = size[(axis+1) % 3] * size[(axis+2) % 3];
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        // Slab test, keeping track of which axis bounds the entry and exit distances.
+        auto t_near = -infinity, t_far = infinity;
+        int near_axis = 0, far_axis = 0;
+
+        for (int axis = 0; axis < 3; axis++) {
+            auto adinv = 1.0 / r.direction()[axis];
+            auto t0 = (min_corner[axis] - r.origin()[axis]) * adinv;
+            auto t1 = (max_corner[axis] - r.origin()[axis]) * adinv;
+            if (adinv < 0) std::swap(t0, t1);
+
+            if (t0 > t_near) { t_near = t0; near_axis = axis; }
+            if (t1 < t_far)  { t_far  = t1; far_axis  = axis; }
+        }
+
+        if (t_near > t_far)
+            return false;
+
+        // Use the entry face, or the exit face when the ray starts inside the box.
+        bool entering = ray_t.surrounds(t_near);
+        if (!entering && !ray_t.surrounds(t_far))
+            return false;
+
+        auto axis = entering ? near_axis : far_axis;
+        rec.t = entering ? t_near : t_far;
+        rec.object = this;
+
+        // The outward normal points against the ray on entry and along it on exit.
+        bool positive_face = (r.direction()[axis] > 0) != entering;
+        rec.prim = std::uint32_t(2*axis + (positive_face ? 1 : 0));
+
+        return true;
+    }
+
+    void set_surface(const ray& r, hit_record& rec) const override {
+        int axis = int(rec.prim / 2);
+        rec.p = r.at(rec.t);
+
+        vec3 outward_normal(0,0,0);
+        outward_normal[axis] = (rec.prim % 2) ? 1 : -1;
+        rec.set_face_normal(r, outward_normal);
+
+        // Face coordinates follow the two remaining axes, each mapped to [0,1].
+        auto a1 = (axis + 1) % 3;
+        auto a2 = (axis + 2) % 3;
+        rec.u = (rec.p[a1] - min_corner[a1]) / (max_corner[a1] - min_corner[a1]);
+        rec.v = (rec.p[a2] - min_corner[a2]) / (max_corner[a2] - min_corner[a2]);
+        rec.mat = mat.get();
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        // Directions are sampled by area over the faces visible from the origin, and every such
+        // direction crosses exactly one of them, so the density is that of a single quad light
+        // spread over the visible area.
+        hit_record rec;
+        if (!this->intersect(ray(origin, direction), interval(0.001, infinity), rec))
+            return 0;
+
+        auto area = visible_area(origin);
+        if (area <= 0)
+            return 0;
+
+        auto distance_squared = rec.t * rec.t * direction.length_squared();
+        auto cosine = std::fabs(direction[rec.prim / 2] / direction.length());
+
+        return distance_squared / (cosine * area);
+    }
+
+    double area() const override { return 2 * (face_area[0] + face_area[1] + face_area[2]); }
+
+    bool sample_surface(surface_sample& s) const override {
+        // A face with probability proportional to its area, then a uniform point on it.
+        auto total = area();
+        if (total <= 0)
+            return false;
+
+        auto pick = random_double(0, total / 2);
+        int axis = 0;
+        while (axis < 2 && (pick -= face_area[axis]) >= 0)
+            axis++;
+        bool positive = random_double() < 0.5;
+
+        auto a1 = (axis + 1) % 3;
+        auto a2 = (axis + 2) % 3;
+        s.u = random_double();
+        s.v = random_double();
+        s.p[axis] = positive ? max_corner[axis] : min_corner[axis];
+        s.p[a1] = min_corner[a1] + s.u * (max_corner[a1] - min_corner[a1]);
+        s.p[a2] = min_corner[a2] + s.v * (max_corner[a2] - min_corner[a2]);
+        s.normal = vec3(0,0,0);
+        s.normal[axis] = positive ? 1 : -1;
+        s.mat = mat.get();
+        s.pdf = 1 / total;
+        return true;
+    }
+
+    double surface_pdf(const point3& p) const override {
+        // Zero unless p lies within the box and on one of its faces.
+        auto size = max_corner - min_corner;
+        auto tolerance = 1e-6 * size.length();
+        bool on_face = false;
+        for (int axis = 0; axis < 3; axis++) {
+            auto below = min_corner[axis] - p[axis], above = p[axis] - max_corner[axis];
+            if (below > tolerance || above > tolerance)
+                return 0;
+            on_face = on_face || std::fabs(below) <= tolerance || std::fabs(above) <= tolerance;
+        }
+        return on_face ? 1 / area() : 0;
+    }
+
+    vec3 random(const point3& origin) const override {
+        // Pick a visible face with probability proportional to its area, then a uniform point on it.
+        int faces[3];
+        int sides[3];
+        int face_count = visible_faces(origin, faces, sides);
+
+        double area = 0;
+        for (int f = 0; f < face_count; f++)
+            area += face_area[faces[f]];
+
+        auto pick = random_double(0, area);
+        int f = 0;
+        for (; f < face_count - 1; f++) {
+            pick -= face_area[faces[f]];
+            if (pick < 0)
+                break;
+        }
+
+        auto axis = faces[f];
+        auto a1 = (axis + 1) % 3;
+        auto a2 = (axis + 2) % 3;
+
+        point3 p;
+        p[axis] = sides[f] > 0 ? max_corner[axis] : min_corner[axis];
+        p[a1] = random_double(min_corner[a1], max_corner[a1]);
+        p[a2] = random_double(min_corner[a2], max_corner[a2]);
+
+        return p - origin;
+    }
+
+  private:
+    point3 min_corner, max_corner;
+    std::shared_ptr<material> mat;
+    aabb bbox;
+    double face_area[3];  // Area of each face perpendicular to the given axis
+
+    int visible_faces(const point3& origin, int faces[3], int sides[3]) const {
+        // Lists the faces (axis, side) facing the origin. From inside the box every face can be
+        // seen, so one face per axis is listed with a random side, which keeps the selection
+        // proportional to area over all six.
+        int count = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            if (origin[axis] < min_corner[axis]) {
+                faces[count] = axis; sides[count++] = -1;
+            } else if (origin[axis] > max_corner[axis]) {
+                faces[count] = axis; sides[count++] = +1;
+            }
+        }
+
+        if (count == 0) {
+            for (int axis = 0; axis < 3; axis++) {
+                faces[axis] = axis;
+                sides[axis] = random_double() < 0.5 ? -1 : +1;
+            }
+            count = 3;
+        }
+
+        return count;
+    }
+
+    double visible_area(const point3& origin) const {
+        // Total area of the faces facing the origin, or of all six faces from inside the box.
+        double area = 0;
+        bool inside = true;
+        for (int axis = 0; axis < 3; axis++) {
+            if (origin[axis] < min_corner[axis] || origin[axis] > max_corner[axis]) {
+                area += face_area[axis];
+                inside = false;
+            }
+        }
+
+        if (inside)
+            area = 2 * (face_area[0] + face_area[1] + face_area[2]);
+
+        return area;
+    }
+};
+
+#endif
@@ -0,0 +1,37 @@
+#include "rtweekend.h"
+
+#include "box.h"
+
+#include <iostream>
+#include <iomanip>
+
+int main() {
+    // The solid angle a box subtends, estimated twice: with directions sampled uniformly over
+    // the sphere, and with the directions box::random() picks weighted by 1 / box::pdf_value().
+    // The two agree when the density matches the sampling; the sum of pdf / (1/4pi) over
+    // uniform directions estimates the integral of the density, which must be 1.
+    box b(point3(-1,-2,3), point3(2,1,5), nullptr);
+    point3 origin(0.5, 2.5, -1);
+
+    int N = 1000000;
+    auto uniform_hits = 0.0;
+    auto pdf_integral = 0.0;
+    auto importance_sum = 0.0;
+    for (int i = 0; i < N; i++) {
+        vec3 d = random_unit_vector();
+        hit_record rec;
+        if (b.hit(ray(origin, d), interval(0.001, infinity), rec))
+            uniform_hits++;
+        pdf_integral += b.pdf_value(origin, d) * 4*pi;
+
+        vec3 sampled = b.random(origin);
+        auto pdf = b.pdf_value(origin, sampled);
+        if (pdf > 0)
+            importance_sum += 1 / pdf;
+    }
+
+    std::cout << std::fixed << std::setprecision(12);
+    std::cout << "Solid angle (uniform)    = " << 4*pi * uniform_hits / N << '\n';
+    std::cout << "Solid angle (importance) = " << importance_sum / N << '\n';
+    std::cout << "Integral of the pdf      = " << pdf_integral / N << '\n';
+}
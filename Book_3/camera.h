@@ -6,8 +6,31 @@
 #include "hittable.h"
 #include "pdf.h"
 #include "material.h"
+#include "environment_light.h"
+#include "irradiance_cache.h"
+#include "path_tracer.h"
+#include "photon_map.h"
+#include "sampler.h"
+#include <chrono>
 #include <omp.h>
 
+// Light transport method used by camera::render.
+enum class integrator_type {
+    mixture,   // One direction from a 50/50 mix of the light and material pdfs
+    nee_mis,   // Explicit light sample with a shadow ray plus a material sample at every
+               // non-specular vertex, combined with the power heuristic
+    restir,    // Direct light at the first non-specular vertex resampled from many light
+               // candidates and reused between neighbouring pixels, with one shadow ray;
+               // deeper vertices use nee_mis
+    guided,    // nee_mis whose material samples are half drawn from the incident light learned
+               // by a path_guide over progressive passes of doubling sample counts
+    bdpt,      // Bidirectional: a camera and a light subpath joined at every pair of vertices,
+               // all strategies combined with the power heuristic; connections to the camera
+               // itself are splatted onto the image
+    mlt,       // Primary-sample-space Metropolis (PSSMLT): Markov chains mutate the numbers that
+               // nee_mis paths consume, spending samples where the image is bright
+};
+
 class camera {
   public:
     double aspect_ratio = 1.0;  // Ratio of image width over height
@@ -21,47 +44,42 @@ class camera {
     double defocus_angle = 0;  // Variation angle of rays through each pixel
     double focus_dist = 10;    // Distance from camera lookfrom point to plane of perfect focus
     color  background;               // Scene background color
-
-    void render(const hittable& world, const hittable& lights) {
-        initialize();
-
-        std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
-        // Allocate buffer for all pixel colors
-        std::vector<std::vector<color>> pixel_buffer(image_height, std::vector<color>(image_width));
-
-        #pragma omp parallel for schedule(dynamic)
-        for (int j = 0; j < image_height; j++) {
-            for (int i = 0; i < image_width; i++) {
-                color pixel_color(0,0,0);
-                for (int s_j = 0; s_j < sqrt_spp; s_j++) {
-                    for (int s_i = 0; s_i < sqrt_spp; s_i++) {
-                        ray r = get_ray(i, j, s_i, s_j);
-                        pixel_color += ray_color(r, max_depth, world, lights);
-                    }
-                }
-                pixel_buffer[j][i] = pixel_samples_scale * pixel_color;
-            }
-            // Only one thread should update the progress bar
-            #pragma omp critical
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-        }
-
-        // Output the image in order (single-threaded)
-        for (int j = 0; j < image_height; j++) {
-            for (int i = 0; i < image_width; i++) {
-                write_color(std::cout, pixel_buffer[j][i]);
-            }
-        }
-
-        std::clog << "\rDone.                 \n";
-    }
+    std::shared_ptr<environment_light> environment;  // Image lighting seen by rays that leave the
+                                                     // scene instead of the background; add it
+                                                     // to the lights too, to sample it
+    integrator_type integrator = integrator_type::mixture;  // Light transport method
+    sampler_type sampler = sampler_type::independent;  // Numbers consumed by camera samples (all
+                                                       // integrators but mlt)
+    int    restir_candidates = 16;  // Light candidates per pixel sample (restir)
+    int    restir_neighbors  = 4;   // Neighbouring reservoirs merged into each pixel (restir)
+    bool   irradiance_caching = false;  // Cache irradiance for secondary diffuse hits (nee_mis,
+                                        // restir and guided)
+    double irradiance_accuracy = 0.3;   // Interpolation error allowed by the cache
+    int    irradiance_gather_rays = 64; // Hemisphere rays traced for each cache record
+    int    caustic_photons = 0;     // Photons traced from the lights for a caustic map, which
+                                    // diffuse hits gather instead of finding caustics by path
+                                    // tracing (nee_mis, restir and guided; 0 disables)
+    double caustic_radius = 0;      // Gather radius of the caustic map (0: 0.25% of the scene's
+                                    // extent)
+    int    mlt_bootstrap_samples = 100000;  // Paths estimating the image brightness (mlt)
+    int    mlt_chains_per_thread = 16;      // Independent Markov chains per thread (mlt)
+    double mlt_large_step = 0.3;            // Probability of a fresh path over a mutation (mlt)
+
+    void render(const hittable& world, const hittable& lights);
 
   private:
+    // The integrators other than mixture and nee_mis generate their rays and splat onto the
+    // image through the camera's private state.
+    friend class guided_integrator;
+    friend class restir_integrator;
+    friend class bdpt_integrator;
+    friend class mlt_integrator;
+
     int    image_height;   // Rendered image height
     double pixel_samples_scale;  // Color scale factor for a sum of pixel samples
     int    sqrt_spp;             // Square root of number of samples per pixel
     double recip_sqrt_spp;       // 1 / sqrt_spp
+    double film_area;            // Area of the viewport scaled to unit distance from the lens
     point3 center;         // Camera center
     point3 pixel00_loc;    // Location of pixel 0, 0
     vec3   pixel_delta_u;  // Offset to pixel to the right
@@ -104,6 +122,7 @@ class camera {
         // Calculate the location of the upper left pixel.
         auto viewport_upper_left = center - (focus_dist * w) - viewport_u/2 - viewport_v/2;
         pixel00_loc = viewport_upper_left + 0.5 * (pixel_delta_u + pixel_delta_v);
+        film_area = (viewport_width / focus_dist) * (viewport_height / focus_dist);
         
         // Calculate the camera defocus disk basis vectors.
         auto defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2));
@@ -115,7 +134,9 @@ class camera {
         // Construct a camera ray originating from the defocus disk and directed at a randomly
         // sampled point around the pixel location i, j for stratified sample square s_i, s_j.
 
-        auto offset = sample_square_stratified(s_i, s_j);
+        // A low-discrepancy sampler already spreads the offsets of a pixel's samples.
+        auto offset = (sampler == sampler_type::independent) ? sample_square_stratified(s_i, s_j)
+                                                             : sample_square();
         auto pixel_sample = pixel00_loc
                           + ((i + offset.x()) * pixel_delta_u)
                           + ((j + offset.y()) * pixel_delta_v);
@@ -128,6 +149,15 @@ class camera {
         return ray(ray_origin, ray_direction, ray_time);
     }
 
+    sample_source* start_camera_sample(pixel_sampler& numbers, int i, int j, int index) const {
+        // The source a camera sample of pixel i, j should draw from, or null to keep drawing
+        // from the thread's generator.
+        if (sampler == sampler_type::independent)
+            return nullptr;
+        numbers.start_sample(i, j, index);
+        return &numbers;
+    }
+
     vec3 sample_square_stratified(int s_i, int s_j) const {
         // Returns the vector to a random point in the square sub-pixel specified by grid
         // indices s_i and s_j, for an idealized unit square pixel [-.5,-.5] to [+.5,+.5].
@@ -149,42 +179,142 @@ class camera {
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    color ray_color(const ray& r, int depth, const hittable& world, const hittable& lights)
-    const {
-        // If we've exceeded the ray bounce limit, no more light is gathered.
-        if (depth <= 0)
-            return color(0,0,0);
-
-        hit_record rec; // Declare rec here
-
-        // If the ray hits nothing, return the background color.
-        if (!world.hit(r, interval(0.001, infinity), rec))
-            return background;
+    ray film_ray(double px, double py) const {
+        // Camera ray through the continuous film position (px, py), in pixels from the upper
+        // left corner of the image.
+        auto pixel_sample = pixel00_loc + (px - 0.5) * pixel_delta_u + (py - 0.5) * pixel_delta_v;
+        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+        return ray(ray_origin, pixel_sample - ray_origin, random_double());
+    }
 
-        scatter_record srec;
-        color color_from_emission = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+    double camera_direction_pdf(const point3& origin, const vec3& direction) const {
+        // Density over solid angle of camera rays from a point on the lens: uniform over the
+        // film, or 1 / (A cos^3) per unit solid angle; zero outside the image.
+        int x, y;
+        if (!raster_position(origin, direction, x, y))
+            return 0;
+        auto cosine = dot(unit_vector(direction), -w);
+        return 1 / (film_area * cosine * cosine * cosine);
+    }
 
-        if (!rec.mat->scatter(r, rec, srec))
-            return color_from_emission;
+    bool raster_position(const point3& origin, const vec3& direction, int& x, int& y) const {
+        // Pixel that a ray from a point on the lens passes through, from where it crosses the
+        // plane of focus (where the viewport lies). False if it misses the image.
+        auto along = dot(direction, -w);
+        if (along <= 0)
+            return false;
+
+        auto q = origin + direction * (focus_dist / along) - pixel00_loc;
+        auto px = dot(q, pixel_delta_u) / pixel_delta_u.length_squared() + 0.5;
+        auto py = dot(q, pixel_delta_v) / pixel_delta_v.length_squared() + 0.5;
+        if (!(px >= 0 && px < image_width && py >= 0 && py < image_height))
+            return false;
+
+        x = int(px);
+        y = int(py);
+        return true;
+    }
 
-        if (srec.skip_pdf) {
-            return srec.attenuation * ray_color(srec.skip_pdf_ray, depth-1, world, lights);
+    void add_splat(std::vector<color>& splats, int x, int y, const color& c) const {
+        // Adds to a shared image from any thread.
+        auto& pixel = splats[y*image_width + x];
+        for (int k = 0; k < 3; k++) {
+            #pragma omp atomic
+            pixel.e[k] += c[k];
         }
+    }
+};
 
-        auto light_ptr = std::make_shared<hittable_pdf>(lights, rec.p);
-        mixture_pdf p(light_ptr, srec.pdf_ptr);
+// The integrators reach into the camera for its rays, so they follow its definition.
+#include "guided_integrator.h"
+#include "restir_integrator.h"
+#include "bdpt_integrator.h"
+#include "mlt_integrator.h"
+
+inline void camera::render(const hittable& world, const hittable& lights) {
+    initialize();
+
+    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+
+    // Allocate buffer for all pixel colors
+    std::vector<std::vector<color>> pixel_buffer(image_height, std::vector<color>(image_width));
+
+    path_tracer tracer;
+    tracer.max_depth = max_depth;
+    tracer.background = background;
+    tracer.environment = environment;
+    tracer.irradiance_gather_rays = irradiance_gather_rays;
+
+    // The cache and the caustic map serve the integrators built on ray_color_mis.
+    bool gathers = integrator == integrator_type::nee_mis || integrator == integrator_type::restir
+                || integrator == integrator_type::guided;
+
+    std::unique_ptr<irradiance_cache> irradiance;
+    if (irradiance_caching && gathers) {
+        // Validity radii are kept between 0.5% and 10% of the scene's extent.
+        auto bounds = world.bounding_box();
+        auto extent = vec3(bounds.x.size(), bounds.y.size(), bounds.z.size()).length();
+        irradiance = std::make_unique<irradiance_cache>(
+            bounds, irradiance_accuracy, 0.005 * extent, 0.1 * extent);
+        tracer.cache = irradiance.get();
+    }
 
-        ray scattered = ray(rec.p, p.generate(), r.time());
-        auto pdf_value = p.value(scattered.direction());
+    std::unique_ptr<photon_map> caustic_map;
+    if (caustic_photons > 0 && gathers) {
+        auto start = std::chrono::steady_clock::now();
+        caustic_map = tracer.trace_caustics(world, lights, caustic_photons, caustic_radius);
+        auto elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        if (caustic_map) {
+            tracer.caustics = caustic_map.get();
+            std::clog << "\rCaustic map: " << caustic_map->size() << " photons stored of "
+                      << caustic_photons << " traced, " << elapsed << " ms\n";
+        }
+    }
 
-        double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+    if (integrator == integrator_type::restir) {
+        restir_integrator(*this, tracer).render(world, lights, pixel_buffer);
+    } else if (integrator == integrator_type::guided) {
+        guided_integrator(*this, tracer).render(world, lights, pixel_buffer);
+    } else if (integrator == integrator_type::bdpt) {
+        bdpt_integrator(*this, tracer).render(world, lights, pixel_buffer);
+    } else if (integrator == integrator_type::mlt) {
+        mlt_integrator(*this, tracer).render(world, lights, pixel_buffer);
+    } else {
+        #pragma omp parallel for schedule(dynamic)
+        for (int j = 0; j < image_height; j++) {
+            pixel_sampler numbers(sampler, sqrt_spp * sqrt_spp);
+            for (int i = 0; i < image_width; i++) {
+                color pixel_color(0,0,0);
+                for (int s_j = 0; s_j < sqrt_spp; s_j++) {
+                    for (int s_i = 0; s_i < sqrt_spp; s_i++) {
+                        sample_source_scope scope(
+                            start_camera_sample(numbers, i, j, s_j*sqrt_spp + s_i));
+                        ray r = get_ray(i, j, s_i, s_j);
+                        pixel_color += (integrator == integrator_type::nee_mis)
+                                     ? tracer.ray_color_mis(r, max_depth, world, lights, -1)
+                                     : tracer.ray_color(r, max_depth, world, lights);
+                    }
+                }
+                pixel_buffer[j][i] = pixel_samples_scale * pixel_color;
+            }
+            // Only one thread should update the progress bar
+            #pragma omp critical
+            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
+        }
+    }
 
-        color sample_color = ray_color(scattered, depth-1, world, lights);
-        color color_from_scatter =
-            (srec.attenuation * scattering_pdf * sample_color) / pdf_value;
+    if (irradiance)
+        std::clog << "\rIrradiance cache: " << irradiance->size() << " records\n";
 
-        return color_from_emission + color_from_scatter;
+    // Output the image in order (single-threaded)
+    for (int j = 0; j < image_height; j++) {
+        for (int i = 0; i < image_width; i++) {
+            write_color(std::cout, pixel_buffer[j][i]);
+        }
     }
-};
 
-#endif
\ No newline at end of file
+    std::clog << "\rDone.                 \n";
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef ENVIRONMENT_LIGHT_H
+#define ENVIRONMENT_LIGHT_H
+
+#include "rtweekend.h"
+#include "alias_table.h"
+#include "hittable.h"
+#include "light_list.h"
+#include "rtw_stb_image.h"
+#include <cmath>
+#include <vector>
+
+
+class environment_light : public hittable {
+  // Light arriving from infinitely far away in every direction, read from a high dynamic range
+  // image in the equirectangular (latitude-longitude) layout that image textures use on spheres:
+  // the top row looks straight up and u = 0.5 faces +x. Rays never hit it; the camera asks for
+  // radiance() when a ray leaves the scene. Added to a light_list it is also sampled as a light,
+  // choosing pixels from an alias table in proportion to luminance * sin(theta), the solid angle
+  // each row of pixels covers, and then a point uniformly within the pixel.
+  public:
+    environment_light(const char* filename, double intensity = 1.0)
+      : image(filename), intensity(intensity)
+    {
+        width = image.width();
+        height = image.height();
+        if (width <= 0 || height <= 0) {
+            std::cerr << "WARNING: environment map '" << filename << "' has no data; it will "
+                         "emit no light.\n";
+            return;
+        }
+
+        std::vector<double> weights(size_t(width) * height);
+        for (int j = 0; j < height; j++) {
+            auto sin_theta = std::sin(pi * (j + 0.5) / height);
+            for (int i = 0; i < width; i++)
+                weights[size_t(j)*width + i] = light_list::luminance(pixel(i, j)) * sin_theta;
+        }
+        pixels = alias_table(weights);
+    }
+
+    color radiance(const vec3& direction) const {
+        // Light arriving along -direction, i.e. seen by a ray travelling along direction.
+        if (pixels.size() == 0)
+            return color(0,0,0);
+        double u, theta;
+        to_map(unit_vector(direction), u, theta);
+        return pixel(column(u), row(theta));
+    }
+
+    double power(double scene_radius) const {
+        // Rough power falling on a scene that fits in a sphere of the given radius, pi R^2 times
+        // the integral of the luminance over the sphere of directions; a selection weight for
+        // light_list::add().
+        auto integral = pixels.total() * 2*pi*pi / (double(width) * height);
+        return pi * scene_radius * scene_radius * integral;
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override { return false; }
+
+    aabb bounding_box() const override {
+        // No surface, so nothing to add to the bounds of the lights it is listed with.
+        return aabb::empty;
+    }
+
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        // Density over solid angle: the pixel's probability over its area in (u, theta), times
+        // the Jacobian 1 / (2 pi^2 sin theta) of the map.
+        if (pixels.size() == 0)
+            return 0;
+        double u, theta;
+        to_map(unit_vector(direction), u, theta);
+        auto sin_theta = std::sin(theta);
+        if (sin_theta <= 0)
+            return 0;
+        auto index = size_t(row(theta))*width + column(u);
+        return pixels.pmf(index) * width * height / (2*pi*pi * sin_theta);
+    }
+
+    vec3 random(const point3& origin) const override {
+        if (pixels.size() == 0)
+            return vec3(0,1,0);
+        auto index = pixels.sample();
+        auto u = (index % width + random_double()) / width;
+        auto theta = pi * (index / width + random_double()) / height;
+        return from_map(u, theta);
+    }
+
+  private:
+    rtw_image image;
+    double intensity;
+    int width = 0, height = 0;
+    alias_table pixels;  // Pixel index j*width + i chosen by luminance * sin(theta)
+
+    color pixel(int i, int j) const {
+        auto p = image.linear_pixel_data(i, j);
+        return intensity * color(p[0], p[1], p[2]);
+    }
+
+    int column(double u) const { return std::min(int(u * width), width - 1); }
+    int row(double theta) const { return std::min(int(theta / pi * height), height - 1); }
+
+    static void to_map(const vec3& d, double& u, double& theta) {
+        // u as in sphere::get_sphere_uv; theta measured from +y, down the rows of the image.
+        u = (std::atan2(-d.z(), d.x()) + pi) / (2*pi);
+        theta = std::acos(std::fmin(std::fmax(d.y(), -1.0), 1.0));
+    }
+
+    static vec3 from_map(double u, double theta) {
+        auto phi = 2*pi*u;
+        auto sin_theta = std::sin(theta);
+        return vec3(-std::cos(phi) * sin_theta, std::cos(theta), std::sin(phi) * sin_theta);
+    }
+};
+
+#endif
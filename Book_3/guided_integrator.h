@@ -0,0 +1,86 @@
+#ifndef GUIDED_INTEGRATOR_H
+#define GUIDED_INTEGRATOR_H
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "path_tracer.h"
+#include "path_guiding.h"
+#include "sampler.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+
+class guided_integrator {
+  // integrator_type::guided: nee_mis whose material samples are half drawn from the incident
+  // light a path_guide learns over progressive passes of doubling sample counts.
+  public:
+    guided_integrator(const camera& cam, path_tracer& tracer) : cam(cam), tracer(tracer) {}
+
+    void render(
+        const hittable& world, const hittable& lights,
+        std::vector<std::vector<color>>& pixel_buffer
+    ) const {
+        // Renders in passes of 1, 2, 4, ... samples per pixel (the last one takes what is left
+        // of the budget). Each pass samples from the guide learned so far while it collects
+        // radiance for the next; since guiding only changes sampling densities, every pass is
+        // unbiased and all of them are averaged into the image.
+        path_guide learned(world.bounding_box());
+        tracer.guide = &learned;
+
+        int total = cam.sqrt_spp * cam.sqrt_spp;
+        int done = 0;
+        std::vector<std::vector<color>> sums(cam.image_height, std::vector<color>(cam.image_width));
+
+        for (int pass = 0; done < total; pass++) {
+            int pass_spp = std::min(1 << pass, total - done);
+            if (total - done - pass_spp < (2 << pass))
+                pass_spp = total - done;
+            learned.collecting = (done + pass_spp < total);
+
+            #pragma omp parallel for schedule(dynamic)
+            for (int j = 0; j < cam.image_height; j++) {
+                pixel_sampler numbers(cam.sampler, total);
+                for (int i = 0; i < cam.image_width; i++) {
+                    for (int s = done; s < done + pass_spp; s++) {
+                        sample_source_scope scope(cam.start_camera_sample(numbers, i, j, s));
+                        auto s_i = s % cam.sqrt_spp;
+                        auto s_j = (s / cam.sqrt_spp) % cam.sqrt_spp;
+                        ray r = cam.get_ray(i, j, s_i, s_j);
+                        sums[j][i] += tracer.ray_color_mis(r, cam.max_depth, world, lights, -1);
+                    }
+                }
+                // Only one thread should update the progress bar
+                #pragma omp critical
+                std::clog << "\rPass " << pass << ", scanlines remaining: "
+                          << (cam.image_height - j) << ' ' << std::flush;
+            }
+            done += pass_spp;
+
+            if (learned.collecting) {
+                auto start = std::chrono::steady_clock::now();
+                learned.refine(pass);
+                auto elapsed = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+
+                std::clog << "\rGuiding after pass " << pass << " (" << done << " spp): "
+                          << learned.spatial_leaves() << " spatial leaves, "
+                          << learned.directional_nodes() << " directional nodes, "
+                          << learned.memory_bytes() / 1024 << " KiB, update "
+                          << elapsed << " ms\n";
+            }
+        }
+
+        for (int j = 0; j < cam.image_height; j++)
+            for (int i = 0; i < cam.image_width; i++)
+                pixel_buffer[j][i] = sums[j][i] / total;
+
+        tracer.guide = nullptr;
+    }
+
+  private:
+    const camera& cam;
+    path_tracer& tracer;
+};
+
+#endif
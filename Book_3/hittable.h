@@ -2,20 +2,30 @@
 #define HITTABLE_H
 
 #include "aabb.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 class material;
+class hittable;
 
 class hit_record
 {
 public:
     point3 p;
     vec3 normal;
-    std::shared_ptr<material> mat;
+    material* mat;  // Non-owning; the hittable that set it keeps the material alive
     double t;
     double u;
     double v;
     bool front_face;
 
+    // Set by hittable::intersect() when only the distance is known so far: the object that owns
+    // the hit, and which of its primitives was hit. The object may also leave parametric
+    // coordinates in u & v for its set_surface() to pick up.
+    const hittable* object;
+    std::uint32_t prim;
+
     void set_face_normal(const ray &r, const vec3 &outward_normal)
     {
         // Sets the hit record normal vector.
@@ -26,6 +36,16 @@ public:
     }
 };
 
+struct surface_sample
+{
+    // Point chosen on the surface of an object, e.g. to emit light from.
+    point3 p;
+    vec3 normal;     // Outward unit normal at p
+    double u, v;
+    material* mat;
+    double pdf;      // Density of the choice over the surface area
+};
+
 class hittable
 {
 public:
@@ -33,6 +53,20 @@ public:
 
     virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0;
 
+    virtual bool intersect(const ray &r, interval ray_t, hit_record &rec) const {
+        // First phase of a hit: finds the closest intersection in ray_t and sets rec.t, but may
+        // defer the surface attributes by pointing rec.object at the primitive that owns them.
+        // The default performs a complete hit, which leaves nothing to defer.
+        if (!hit(r, ray_t, rec))
+            return false;
+        rec.object = nullptr;
+        return true;
+    }
+
+    virtual void set_surface(const ray &r, hit_record &rec) const {
+        // Second phase: fills in the point, normal, UV & material of a hit found by intersect().
+    }
+
     virtual aabb bounding_box() const = 0;
 
     virtual double pdf_value(const point3& origin, const vec3& direction) const {
@@ -42,6 +76,49 @@ public:
     virtual vec3 random(const point3& origin) const {
         return vec3(1,0,0);
     }
+
+    virtual double area() const {
+        // Surface area, used to estimate the power of an emitter. Zero if unknown.
+        return 0.0;
+    }
+
+    virtual vec3 emission_axis() const {
+        // Unit normal of a flat emitter that lights only its front side, or zero when the object
+        // may emit in every direction. Used to bound the light a group of emitters can send.
+        return vec3(0,0,0);
+    }
+
+    virtual bool sample_surface(surface_sample& s) const {
+        // Picks a point on the surface, with its density over area, for tracing light out of
+        // the object. False for objects that cannot be sampled this way.
+        return false;
+    }
+
+    virtual double surface_pdf(const point3& p) const {
+        // Density over area with which sample_surface() picks the point p, zero for points off
+        // the surface.
+        return 0.0;
+    }
+
+    virtual void gather_primitives(
+        const std::shared_ptr<hittable>& self, std::vector<std::shared_ptr<hittable>>& found
+    ) const {
+        // Appends the leaf objects of a scene, e.g. to find its emitters; `self` is the pointer
+        // the object is held by. Groups list their members, anything else (transformed
+        // instances too) is a leaf.
+        found.push_back(self);
+    }
+
+protected:
+    bool two_phase_hit(const ray &r, interval ray_t, hit_record &rec) const {
+        // hit() for objects that override intersect(): surface attributes are only computed
+        // for the final closest hit, not for every candidate found along the way.
+        if (!intersect(r, ray_t, rec))
+            return false;
+        if (rec.object)
+            rec.object->set_surface(r, rec);
+        return true;
+    }
 };
 
 class translate : public hittable
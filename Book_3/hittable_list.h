@@ -24,17 +24,21 @@ public:
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override
     {
-        hit_record temp_rec;
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray &r, interval ray_t, hit_record &rec) const override
+    {
+        // Children only write `rec` when they report a closer hit, so it is passed straight through.
         bool hit_anything = false;
         auto closest_so_far = ray_t.max;
 
         for (const auto &object : objects)
         {
-            if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec))
+            if (object->intersect(r, interval(ray_t.min, closest_so_far), rec))
             {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                closest_so_far = rec.t;
             }
         }
 
@@ -58,6 +62,34 @@ public:
         return objects[random_int(0, int_size-1)]->random(origin);
     }
 
+    bool sample_surface(surface_sample& s) const override {
+        // An object chosen uniformly, as in random().
+        if (objects.empty())
+            return false;
+        auto int_size = int(objects.size());
+        if (!objects[random_int(0, int_size-1)]->sample_surface(s))
+            return false;
+        s.pdf /= int_size;
+        return true;
+    }
+
+    double surface_pdf(const point3& p) const override {
+        auto weight = 1.0 / objects.size();
+        auto sum = 0.0;
+
+        for (const auto& object : objects)
+            sum += weight * object->surface_pdf(p);
+
+        return sum;
+    }
+
+    void gather_primitives(
+        const std::shared_ptr<hittable>& self, std::vector<std::shared_ptr<hittable>>& found
+    ) const override {
+        for (const auto& object : objects)
+            object->gather_primitives(object, found);
+    }
+
 private:
     aabb bbox;
 };
@@ -0,0 +1,153 @@
+#ifndef IRRADIANCE_CACHE_H
+#define IRRADIANCE_CACHE_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include <array>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+
+class irradiance_cache {
+  // Sparse irradiance samples on diffuse surfaces, interpolated between (Ward et al. 1988).
+  // Each record holds the irradiance at a point together with a validity radius, the harmonic
+  // mean distance to the surfaces seen from it; a record serves points whose distance and
+  // normal deviation are small for that radius. Records live in an octree over the scene and
+  // are added lazily by whichever thread first misses; lookups share a lock, inserts take it.
+  public:
+    double accuracy;  // Allowed error a: a record serves points where its weight exceeds 1/a
+
+    irradiance_cache(const aabb& bounds, double accuracy, double min_radius, double max_radius)
+      : accuracy(accuracy), min_radius(min_radius), max_radius(max_radius),
+        root_center(bounds.x.min + bounds.x.size()/2, bounds.y.min + bounds.y.size()/2,
+                    bounds.z.min + bounds.z.size()/2),
+        root_half(std::fmax(bounds.x.size(), std::fmax(bounds.y.size(), bounds.z.size())) / 2),
+        root(std::make_unique<node>())
+    {}
+
+    bool lookup(const point3& p, const vec3& n, color& irradiance) const {
+        // Weighted average of the records valid at p with unit normal n; false if none is.
+        std::shared_lock<std::shared_mutex> guard(lock);
+
+        color sum(0,0,0);
+        double weight_sum = 0;
+
+        const node* current = root.get();
+        point3 center = root_center;
+        double half = root_half;
+        while (current) {
+            for (const auto& rec : current->records) {
+                auto w = weight(rec, p, n);
+                if (w > 0) {
+                    sum += w * rec.irradiance;
+                    weight_sum += w;
+                }
+            }
+
+            int octant = octant_of(p, center);
+            half /= 2;
+            center = child_center(center, half, octant);
+            current = current->children[octant].get();
+        }
+
+        if (weight_sum <= 0)
+            return false;
+        irradiance = sum / weight_sum;
+        return true;
+    }
+
+    void insert(const point3& p, const vec3& n, const color& irradiance, double harmonic_distance) {
+        record rec { p, n, irradiance, std::fmin(std::fmax(harmonic_distance, min_radius), max_radius) };
+
+        // The record can serve points up to a * R away; it goes into every node of about that
+        // size that the region overlaps.
+        auto reach = accuracy * rec.radius;
+
+        std::unique_lock<std::shared_mutex> guard(lock);
+        insert(*root, root_center, root_half, rec, reach, 0);
+        record_count++;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        return record_count;
+    }
+
+  private:
+    struct record {
+        point3 p;
+        vec3 n;
+        color irradiance;
+        double radius;
+    };
+
+    struct node {
+        std::vector<record> records;
+        std::array<std::unique_ptr<node>, 8> children;
+    };
+
+    static constexpr int max_depth = 16;
+
+    double min_radius, max_radius;
+    point3 root_center;
+    double root_half;
+    std::unique_ptr<node> root;
+    size_t record_count = 0;
+    mutable std::shared_mutex lock;
+
+    double weight(const record& rec, const point3& p, const vec3& n) const {
+        // Ward's weight 1 / (d/R + sqrt(1 - n.n_i)), or 0 where the record does not apply:
+        // too far or too tilted for the accuracy, or with p in front of it (where the record's
+        // view of the scene would be partly occluded).
+        auto offset = p - rec.p;
+        auto distance = offset.length();
+        auto deviation = std::sqrt(std::fmax(0, 1 - dot(n, rec.n)));
+        auto error = distance / rec.radius + deviation;
+        if (error >= accuracy)
+            return 0;
+        if (dot(offset, (n + rec.n) / 2) < -0.05 * rec.radius)
+            return 0;
+        return 1 / std::fmax(error, 1e-6);
+    }
+
+    void insert(node& current, const point3& center, double half, const record& rec,
+                double reach, int depth) {
+        if (half < 2 * reach || depth >= max_depth) {
+            current.records.push_back(rec);
+            return;
+        }
+
+        for (int octant = 0; octant < 8; octant++) {
+            auto c = child_center(center, half/2, octant);
+            if (!overlaps(c, half/2, rec.p, reach))
+                continue;
+            if (!current.children[octant])
+                current.children[octant] = std::make_unique<node>();
+            insert(*current.children[octant], c, half/2, rec, reach, depth + 1);
+        }
+    }
+
+    static int octant_of(const point3& p, const point3& center) {
+        return (p.x() >= center.x() ? 1 : 0) | (p.y() >= center.y() ? 2 : 0)
+             | (p.z() >= center.z() ? 4 : 0);
+    }
+
+    static point3 child_center(const point3& center, double child_half, int octant) {
+        return center + vec3((octant & 1) ? child_half : -child_half,
+                             (octant & 2) ? child_half : -child_half,
+                             (octant & 4) ? child_half : -child_half);
+    }
+
+    static bool overlaps(const point3& center, double half, const point3& p, double reach) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (p[axis] + reach < center[axis] - half || p[axis] - reach > center[axis] + half)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef LIGHT_LIST_H
+#define LIGHT_LIST_H
+
+#include "rtweekend.h"
+#include "alias_table.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+class light_list : public hittable {
+  // Set of lights for direct-light sampling. Unlike a plain hittable_list, which picks every
+  // light with the same probability, each light is chosen in proportion to its emitted power
+  // through an alias table, so a bright lamp is not starved by many dim emitters.
+  public:
+    light_list() {}
+
+    void add(std::shared_ptr<hittable> light, double power) {
+        // Adds a light with the given selection weight (its power, in any consistent unit).
+        lights.add(light);
+        powers.push_back(power);
+        selection = alias_table(powers);
+    }
+
+    void add(std::shared_ptr<hittable> light, const color& radiance) {
+        // Adds a one-sided diffuse emitter of the given radiance, whose power is pi * area * L.
+        add(light, pi * light->area() * luminance(radiance));
+    }
+
+    static light_list from_scene(const hittable& world, double attractor_share = 0) {
+        // Every primitive of `world` whose material is a diffuse_light, weighted by the power
+        // it emits, so the lights are the scene's own objects and cannot drift out of sync with
+        // it. A positive `attractor_share` also adds the dielectric primitives, with that share
+        // of the choices split evenly among them: they emit nothing, but the mixture integrator
+        // then sends part of its rays through them towards the caustics they focus.
+        std::vector<std::shared_ptr<hittable>> primitives;
+        world.gather_primitives(nullptr, primitives);
+
+        // The alias table is built once, at the end, rather than on every add().
+        light_list result;
+        std::vector<std::shared_ptr<hittable>> attractors;
+        double total_power = 0;
+        for (const auto& primitive : primitives) {
+            surface_sample s;
+            if (!primitive || !primitive->sample_surface(s) || !s.mat)
+                continue;
+            if (s.mat->kind() == material_kind::diffuse_light) {
+                result.lights.add(primitive);
+                result.powers.push_back(emitted_power(*primitive));
+                total_power += result.powers.back();
+            } else if (s.mat->kind() == material_kind::dielectric && attractor_share > 0) {
+                attractors.push_back(primitive);
+            }
+        }
+
+        if (result.size() == 0) {
+            std::cerr << "WARNING: no diffuse_light primitive that can be sampled by area found "
+                         "in the scene; there are no lights to sample.\n";
+            return result;
+        }
+
+        auto share = std::fmin(attractor_share, 0.99);
+        for (const auto& attractor : attractors) {
+            result.lights.add(attractor);
+            result.powers.push_back(total_power * share / (1 - share) / attractors.size());
+        }
+        result.selection = alias_table(result.powers);
+        return result;
+    }
+
+    static double emitted_power(const hittable& light, int samples = 64) {
+        // pi times the emitted luminance integrated over the surface (a one-sided diffuse
+        // emitter's power), estimated from points that sample_surface() picks.
+        double sum = 0;
+        for (int k = 0; k < samples; k++) {
+            surface_sample s;
+            if (!light.sample_surface(s) || !s.mat || s.pdf <= 0)
+                return 0;
+            ray towards(s.p + s.normal, -s.normal);
+            hit_record rec;
+            rec.p = s.p;
+            rec.t = 1;
+            rec.u = s.u;
+            rec.v = s.v;
+            rec.mat = s.mat;
+            rec.set_face_normal(towards, s.normal);
+            sum += luminance(emitted(*s.mat, towards, rec)) / s.pdf;
+        }
+        return pi * sum / samples;
+    }
+
+    void report(std::ostream& out) const {
+        // One line per light: where it is, its area, selection weight and probability.
+        out << "Lights: " << size() << ", total weight " << selection.total() << '\n';
+        for (size_t i = 0; i < size(); i++) {
+            auto box = lights.objects[i]->bounding_box();
+            out << "  light " << i << ": center ("
+                << (box.x.min + box.x.max)/2 << ", " << (box.y.min + box.y.max)/2 << ", "
+                << (box.z.min + box.z.max)/2 << "), area " << lights.objects[i]->area()
+                << ", weight " << powers[i] << ", probability " << pmf(i) << '\n';
+        }
+    }
+
+    size_t size() const { return lights.objects.size(); }
+
+    double pmf(size_t index) const { return selection.pmf(index); }
+
+    const std::shared_ptr<hittable>& operator[](size_t index) const {
+        return lights.objects[index];
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return lights.hit(r, ray_t, rec);
+    }
+
+    aabb bounding_box() const override { return lights.bounding_box(); }
+
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        auto sum = 0.0;
+        for (size_t i = 0; i < size(); i++) {
+            if (selection.pmf(i) > 0)
+                sum += selection.pmf(i) * lights.objects[i]->pdf_value(origin, direction);
+        }
+        return sum;
+    }
+
+    vec3 random(const point3& origin) const override {
+        if (size() == 0)
+            return vec3(1,0,0);
+        return lights.objects[selection.sample()]->random(origin);
+    }
+
+    bool sample_surface(surface_sample& s) const override {
+        // A light chosen in proportion to its power, then a point on it.
+        if (size() == 0)
+            return false;
+        auto index = selection.sample();
+        if (!lights.objects[index]->sample_surface(s))
+            return false;
+        s.pdf *= selection.pmf(index);
+        return true;
+    }
+
+    double surface_pdf(const point3& p) const override {
+        auto sum = 0.0;
+        for (size_t i = 0; i < size(); i++) {
+            if (selection.pmf(i) > 0)
+                sum += selection.pmf(i) * lights.objects[i]->surface_pdf(p);
+        }
+        return sum;
+    }
+
+    static double luminance(const color& c) {
+        return 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+    }
+
+  private:
+    hittable_list lights;
+    std::vector<double> powers;
+    alias_table selection;
+};
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef LIGHT_TREE_H
+#define LIGHT_TREE_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "light_list.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+class light_tree : public hittable {
+  // Hierarchy over many lights for direct-light sampling (after Conty Estevez & Kulla 2018).
+  // Every node stores the bounds, total power and orientation cone of the lights below it.
+  // Sampling walks from the root towards one light, choosing each child with probability
+  // proportional to an upper bound of its contribution at the shading point, so cost grows
+  // with the depth of the tree rather than the number of lights. pdf_value() follows only the
+  // branches whose bounds the direction crosses, multiplying the same child probabilities.
+  public:
+    light_tree() {}
+
+    void add(std::shared_ptr<hittable> light, double power) {
+        // Adds a light with the given power. build() must be called after the last add().
+        lights.add(light);
+        pending.push_back({ std::uint32_t(pending.size()), light->bounding_box(),
+                            std::fmax(0, power), cone::of(*light) });
+    }
+
+    void add(std::shared_ptr<hittable> light, const color& radiance) {
+        // Adds a one-sided diffuse emitter of the given radiance, whose power is pi * area * L.
+        add(light, pi * light->area() * light_list::luminance(radiance));
+    }
+
+    void build() {
+        nodes.clear();
+        if (!pending.empty()) {
+            nodes.reserve(2 * pending.size());
+            build(0, pending.size());
+        }
+    }
+
+    size_t size() const { return lights.objects.size(); }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return lights.hit(r, ray_t, rec);
+    }
+
+    aabb bounding_box() const override { return lights.bounding_box(); }
+
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        if (nodes.empty())
+            return 0;
+
+        struct stack_entry {
+            std::uint32_t index;
+            double pmf;
+        };
+        stack_entry stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = { 0, 1.0 };
+
+        ray r(origin, direction);
+        auto sum = 0.0;
+
+        while (stack_size > 0) {
+            auto entry = stack[--stack_size];
+            const auto& n = nodes[entry.index];
+
+            if (n.is_leaf()) {
+                sum += entry.pmf * lights.objects[n.light]->pdf_value(origin, direction);
+                continue;
+            }
+
+            double p_left, p_right;
+            child_probabilities(n, origin, p_left, p_right);
+
+            const auto& left = nodes[entry.index + 1];
+            const auto& right = nodes[n.right];
+            if (p_right > 0 && right.bbox.hit(r, interval(0.001, infinity)))
+                stack[stack_size++] = { n.right, entry.pmf * p_right };
+            if (p_left > 0 && left.bbox.hit(r, interval(0.001, infinity)))
+                stack[stack_size++] = { entry.index + 1, entry.pmf * p_left };
+        }
+
+        return sum;
+    }
+
+    vec3 random(const point3& origin) const override {
+        if (nodes.empty())
+            return vec3(1,0,0);
+
+        std::uint32_t index = 0;
+        while (!nodes[index].is_leaf()) {
+            const auto& n = nodes[index];
+            double p_left, p_right;
+            child_probabilities(n, origin, p_left, p_right);
+            index = (random_double() < p_left) ? index + 1 : n.right;
+        }
+
+        return lights.objects[nodes[index].light]->random(origin);
+    }
+
+    bool sample_surface(surface_sample& s) const override {
+        // With no shading point to bound importance against, the walk follows power alone.
+        if (nodes.empty())
+            return false;
+
+        std::uint32_t index = 0;
+        double pmf = 1;
+        while (!nodes[index].is_leaf()) {
+            const auto& n = nodes[index];
+            auto p_left = power_probability(n);
+            if (random_double() < p_left) {
+                pmf *= p_left;
+                index = index + 1;
+            } else {
+                pmf *= 1 - p_left;
+                index = n.right;
+            }
+        }
+
+        if (!lights.objects[nodes[index].light]->sample_surface(s))
+            return false;
+        s.pdf *= pmf;
+        return true;
+    }
+
+    double surface_pdf(const point3& p) const override {
+        // Follows the branches whose bounds hold p, as pdf_value() does for directions.
+        if (nodes.empty())
+            return 0;
+
+        struct stack_entry {
+            std::uint32_t index;
+            double pmf;
+        };
+        stack_entry stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = { 0, 1.0 };
+        auto sum = 0.0;
+
+        while (stack_size > 0) {
+            auto entry = stack[--stack_size];
+            const auto& n = nodes[entry.index];
+
+            if (n.is_leaf()) {
+                sum += entry.pmf * lights.objects[n.light]->surface_pdf(p);
+                continue;
+            }
+
+            auto p_left = power_probability(n);
+            if (p_left < 1 && contains(nodes[n.right].bbox, p))
+                stack[stack_size++] = { n.right, entry.pmf * (1 - p_left) };
+            if (p_left > 0 && contains(nodes[entry.index + 1].bbox, p))
+                stack[stack_size++] = { entry.index + 1, entry.pmf * p_left };
+        }
+
+        return sum;
+    }
+
+  private:
+    struct cone {
+        // Directions the emitted light can leave in: every direction within theta_o of `axis`,
+        // each spreading over a further 90 degrees as a diffuse emitter does.
+        vec3 axis;
+        double cos_theta_o;  // -1 for emitters that shine all around
+
+        static cone of(const hittable& light) {
+            auto n = light.emission_axis();
+            if (n.length_squared() == 0)
+                return { vec3(0,0,1), -1 };
+            return { unit_vector(n), 1 };
+        }
+
+        static cone merge(const cone& a, const cone& b) {
+            // Smallest cone (as in pbrt-v4's DirectionCone union) containing both.
+            auto theta_a = std::acos(std::clamp(a.cos_theta_o, -1.0, 1.0));
+            auto theta_b = std::acos(std::clamp(b.cos_theta_o, -1.0, 1.0));
+            auto theta_d = std::acos(std::clamp(dot(a.axis, b.axis), -1.0, 1.0));
+
+            if (std::fmin(theta_d + theta_b, pi) <= theta_a) return a;
+            if (std::fmin(theta_d + theta_a, pi) <= theta_b) return b;
+
+            auto theta_o = (theta_a + theta_d + theta_b) / 2;
+            if (theta_o >= pi)
+                return { a.axis, -1 };
+
+            // Rotate a's axis towards b's by theta_o - theta_a.
+            auto rotation_axis = cross(a.axis, b.axis);
+            if (rotation_axis.length_squared() < 1e-16)
+                return { a.axis, -1 };
+            rotation_axis = unit_vector(rotation_axis);
+            auto theta_r = theta_o - theta_a;
+            auto w = a.axis * std::cos(theta_r) + cross(rotation_axis, a.axis) * std::sin(theta_r);
+
+            return { unit_vector(w), std::cos(theta_o) };
+        }
+    };
+
+    struct light_ref {
+        std::uint32_t index;
+        aabb bbox;
+        double power;
+        cone directions;
+    };
+
+    struct node {
+        aabb bbox;
+        double power;
+        cone directions;
+        std::uint32_t light;  // Leaf: index of the light.
+        std::uint32_t right;  // Interior: index of the right child (the left child is next).
+
+        bool is_leaf() const { return right == 0; }
+    };
+
+    hittable_list lights;
+    std::vector<light_ref> pending;
+    std::vector<node> nodes;
+
+    static double importance(const node& n, const point3& p) {
+        // Upper bound of the light that any point of the node can send towards p.
+        if (n.power <= 0)
+            return 0;
+
+        point3 center(n.bbox.x.min + n.bbox.x.size()/2, n.bbox.y.min + n.bbox.y.size()/2,
+                      n.bbox.z.min + n.bbox.z.size()/2);
+        auto radius_squared =
+            (n.bbox.x.size()*n.bbox.x.size() + n.bbox.y.size()*n.bbox.y.size()
+             + n.bbox.z.size()*n.bbox.z.size()) / 4;
+
+        auto to_p = p - center;
+        auto distance_squared = std::fmax(to_p.length_squared(), radius_squared);
+
+        if (n.directions.cos_theta_o <= -1)
+            return n.power / distance_squared;
+
+        // Angle between the cone axis and p, less the cone spread and the angle the bounds
+        // subtend from p, is the smallest angle any emitter normal can make with p.
+        auto cos_theta_w = dot(n.directions.axis, unit_vector(to_p));
+        auto sin_theta_w = std::sqrt(std::fmax(0, 1 - cos_theta_w*cos_theta_w));
+        auto cos_theta_o = n.directions.cos_theta_o;
+        auto sin_theta_o = std::sqrt(std::fmax(0, 1 - cos_theta_o*cos_theta_o));
+
+        double cos_theta_b = -1;
+        if (to_p.length_squared() > radius_squared)
+            cos_theta_b = std::sqrt(1 - radius_squared / to_p.length_squared());
+        auto sin_theta_b = std::sqrt(std::fmax(0, 1 - cos_theta_b*cos_theta_b));
+
+        // cos(max(0, theta_w - theta_o)), then cos(max(0, that - theta_b)).
+        auto cos_x = (cos_theta_w > cos_theta_o) ? 1.0
+                   : cos_theta_w*cos_theta_o + sin_theta_w*sin_theta_o;
+        auto sin_x = std::sqrt(std::fmax(0, 1 - cos_x*cos_x));
+        auto cos_theta = (cos_x > cos_theta_b) ? 1.0 : cos_x*cos_theta_b + sin_x*sin_theta_b;
+
+        // Diffuse emitters send nothing beyond 90 degrees from their normal.
+        if (cos_theta <= 0)
+            return 0;
+
+        return n.power * cos_theta / distance_squared;
+    }
+
+    double power_probability(const node& n) const {
+        // Probability of the left child when choosing by power alone.
+        auto left = nodes[&n - nodes.data() + 1].power, right = nodes[n.right].power;
+        return (left + right > 0) ? left / (left + right) : 0.5;
+    }
+
+    static bool contains(const aabb& box, const point3& p) {
+        auto tolerance = 1e-6 * (box.x.size() + box.y.size() + box.z.size());
+        return box.x.expand(tolerance).contains(p.x()) && box.y.expand(tolerance).contains(p.y())
+            && box.z.expand(tolerance).contains(p.z());
+    }
+
+    void child_probabilities(const node& n, const point3& p, double& p_left, double& p_right)
+    const {
+        auto& left = nodes[&n - nodes.data() + 1];
+        auto& right = nodes[n.right];
+        auto i_left = importance(left, p);
+        auto i_right = importance(right, p);
+
+        if (i_left + i_right <= 0) {
+            // The bounds of both children are tighter than their parent's and may rule out
+            // every light below, yet the walk must still end at a light; split by power.
+            i_left = left.power;
+            i_right = right.power;
+            if (i_left + i_right <= 0)
+                i_left = i_right = 1;
+        }
+
+        p_left = i_left / (i_left + i_right);
+        p_right = 1 - p_left;
+    }
+
+    void build(size_t start, size_t end) {
+        // Builds the subtree over pending[start, end) in depth-first order, splitting at the
+        // median centroid along the widest axis of the centroids.
+        auto node_index = nodes.size();
+        nodes.emplace_back();
+
+        aabb box, centroid_box;
+        double power = 0;
+        cone directions = pending[start].directions;
+        for (size_t i = start; i < end; i++) {
+            box = aabb(box, pending[i].bbox);
+            auto c = centroid(pending[i].bbox);
+            centroid_box = aabb(centroid_box, aabb(c, c));
+            power += pending[i].power;
+            if (i > start)
+                directions = cone::merge(directions, pending[i].directions);
+        }
+
+        nodes[node_index].bbox = box;
+        nodes[node_index].power = power;
+        nodes[node_index].directions = directions;
+        nodes[node_index].right = 0;
+
+        if (end - start == 1) {
+            nodes[node_index].light = pending[start].index;
+            return;
+        }
+
+        int axis = centroid_box.longest_axis();
+        auto mid = start + (end - start)/2;
+        std::nth_element(std::begin(pending) + start, std::begin(pending) + mid,
+            std::begin(pending) + end,
+            [axis](const light_ref& a, const light_ref& b) {
+                return centroid(a.bbox)[axis] < centroid(b.bbox)[axis];
+            });
+
+        build(start, mid);
+        nodes[node_index].right = std::uint32_t(nodes.size());
+        build(mid, end);
+    }
+
+    static point3 centroid(const aabb& box) {
+        return point3(box.x.min + box.x.size()/2, box.y.min + box.y.size()/2,
+                      box.z.min + box.z.size()/2);
+    }
+};
+
+#endif
@@ -2,7 +2,9 @@
 
 #include "camera.h"
 #include "hittable_list.h"
+#include "light_list.h"
 #include "material.h"
+#include "material_table.h"
 #include <memory>
 #include "quad.h"
 #include "sphere.h"
@@ -13,11 +15,12 @@ int main() {
     hittable_list world;
 
     // Materiais
-    auto grad_lamb = make_shared<lambertian>(color(.65, .05, .05)); // gradiente
-    auto proc_metal = make_shared<metal>(color(.8, .8, .9), 0.2); // tintura procedural
-    auto ceramic_mat = make_shared<ceramic>(color(.85, .82, .75), 0.3, 0.25); // cerâmica
-    auto light = make_shared<diffuse_light>(color(15, 15, 15));
-    auto glass = make_shared<dielectric>(1.5);
+    material_table materials(5);
+    auto grad_lamb = materials.add<lambertian>(color(.65, .05, .05)); // gradiente
+    auto proc_metal = materials.add<metal>(color(.8, .8, .9), 0.2); // tintura procedural
+    auto ceramic_mat = materials.add<ceramic>(color(.85, .82, .75), 0.3, 0.25); // cerâmica
+    auto light = materials.add<diffuse_light>(color(15, 15, 15));
+    auto glass = materials.add<dielectric>(1.5);
 
     // Cornell box sides
     world.add(make_shared<quad>(point3(555,0,0), vec3(0,0,555), vec3(0,555,0), grad_lamb)); // verde
@@ -36,11 +39,10 @@ int main() {
     world.add(make_shared<sphere>(point3(300,40,100), 40, ceramic_mat)); // esfera cerâmica
     world.add(make_shared<sphere>(point3(450,40,120), 40, proc_metal)); // esfera metal
 
-    // Luzes para amostragem
-    auto empty_material = shared_ptr<material>();
-    hittable_list lights;
-    lights.add(make_shared<quad>(point3(213,554,227), vec3(130,0,0), vec3(0,0,105), empty_material));
-    lights.add(make_shared<sphere>(point3(190,90,190), 90, empty_material));
+    // Luzes para amostragem: as primitivas emissoras da própria cena, escolhidas
+    // proporcionalmente à potência emitida
+    auto lights = light_list::from_scene(world);
+    lights.report(clog);
 
     camera cam;
 
@@ -50,6 +52,13 @@ int main() {
     cam.samples_per_pixel = 500;
     cam.max_depth         = 50;
     cam.background        = color(0,0,0);
+    // Para cenas abertas, um mapa de ambiente HDR ilumina a cena e entra na amostragem de luzes:
+    // auto sky = make_shared<environment_light>("sky.hdr");
+    // lights.add(sky, sky->power(800));
+    // cam.environment = sky;
+    cam.integrator        = integrator_type::nee_mis;
+    cam.sampler           = sampler_type::sobol; // amostras de baixa discrepância (Sobol embaralhado)
+    cam.caustic_photons   = 1000000; // cáusticas da esfera de vidro por mapa de fótons
 
     cam.vfov     = 40;
 
@@ -2,7 +2,9 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include <algorithm>
 #include <memory>
+#include <type_traits>
 #include "hittable.h"
 #include "ray.h"
 #include "color.h"
@@ -14,16 +16,24 @@ class scatter_record
 {
 public:
     color attenuation;
-    std::shared_ptr<pdf> pdf_ptr;
+    const pdf* pdf_ptr;      // Points into pdf_store, or null when skip_pdf is set
     bool skip_pdf;
     ray skip_pdf_ray;
+    pdf_storage pdf_store;   // Holds the scattering pdf by value; no per-bounce allocation
 };
 
+// Tag of the built-in material types, used by visit_material() to call them without virtual
+// dispatch. Materials defined elsewhere keep the `other` tag and are called virtually; the
+// built-in types are final, so no subclass can inherit a tag and have its overrides skipped.
+enum class material_kind { other, lambertian, metal, ceramic, dielectric, diffuse_light, isotropic };
+
 class material
 {
 public:
     virtual ~material() = default;
 
+    material_kind kind() const { return tag; }
+
     virtual color emitted(
         const ray &r_in, const hit_record &rec, double u, double v, const point3 &p) const
     {
@@ -39,20 +49,23 @@ public:
     {
         return 0;
     }
+
+protected:
+    material_kind tag = material_kind::other;
 };
 
-class lambertian : public material
+class lambertian final : public material
 {
 public:
-    lambertian(const color &albedo) : tex(std::make_shared<solid_color>(albedo)) {}
-    lambertian(std::shared_ptr<texture> tex) : tex(tex) {}
+    lambertian(const color &albedo) : tex(std::make_shared<solid_color>(albedo)) { tag = material_kind::lambertian; }
+    lambertian(std::shared_ptr<texture> tex) : tex(tex) { tag = material_kind::lambertian; }
 
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
         // Gradiente de cor baseado na posição Y
         double gradient = std::clamp(rec.p.y() / 555.0, 0.0, 1.0);
         color grad_color = lerp(tex->value(rec.u, rec.v, rec.p), color(1,1,1), gradient);
         srec.attenuation = grad_color;
-        srec.pdf_ptr = std::make_shared<cosine_pdf>(rec.normal);
+        srec.pdf_ptr = srec.pdf_store.emplace<cosine_pdf>(rec.normal);
         srec.skip_pdf = false;
         return true;
     }
@@ -72,10 +85,10 @@ private:
     std::shared_ptr<texture> tex;
 };
 
-class metal : public material
+class metal final : public material
 {
 public:
-    metal(const color &albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
+    metal(const color &albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) { tag = material_kind::metal; }
 
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
         // Tintura procedural e rugosidade variável conforme posição
@@ -99,17 +112,17 @@ private:
 };
 
 // Novo material: Cerâmica
-class ceramic : public material {
+class ceramic final : public material {
 public:
     ceramic(const color& base, double roughness = 0.3, double shine = 0.2)
-        : base_color(base), roughness(roughness), shine(shine) {}
+        : base_color(base), roughness(roughness), shine(shine) { tag = material_kind::ceramic; }
 
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
         // Cerâmica: cor base, leve brilho, rugosidade média
         double highlight = std::pow(std::max(dot(unit_vector(r_in.direction()), rec.normal), 0.0), 20.0);
         color final_color = lerp(base_color, color(1,1,1), shine * highlight);
         srec.attenuation = final_color;
-        srec.pdf_ptr = std::make_shared<cosine_pdf>(rec.normal);
+        srec.pdf_ptr = srec.pdf_store.emplace<cosine_pdf>(rec.normal);
         srec.skip_pdf = false;
         return true;
     }
@@ -128,10 +141,10 @@ private:
     }
 };
 
-class dielectric : public material
+class dielectric final : public material
 {
 public:
-    dielectric(double refraction_index) : refraction_index(refraction_index) {}
+    dielectric(double refraction_index) : refraction_index(refraction_index) { tag = material_kind::dielectric; }
 
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
         srec.attenuation = color(1.0, 1.0, 1.0);
@@ -169,11 +182,11 @@ private:
     }
 };
 
-class diffuse_light : public material
+class diffuse_light final : public material
 {
 public:
-    diffuse_light(std::shared_ptr<texture> tex) : tex(tex) {}
-    diffuse_light(const color &emit) : tex(std::make_shared<solid_color>(emit)) {}
+    diffuse_light(std::shared_ptr<texture> tex) : tex(tex) { tag = material_kind::diffuse_light; }
+    diffuse_light(const color &emit) : tex(std::make_shared<solid_color>(emit)) { tag = material_kind::diffuse_light; }
 
     color emitted(const ray &r_in, const hit_record &rec, double u, double v, const point3 &p)
         const override
@@ -187,15 +200,15 @@ private:
     std::shared_ptr<texture> tex;
 };
 
-class isotropic : public material
+class isotropic final : public material
 {
 public:
-    isotropic(const color &albedo) : tex(std::make_shared<solid_color>(albedo)) {}
-    isotropic(std::shared_ptr<texture> tex) : tex(tex) {}
+    isotropic(const color &albedo) : tex(std::make_shared<solid_color>(albedo)) { tag = material_kind::isotropic; }
+    isotropic(std::shared_ptr<texture> tex) : tex(tex) { tag = material_kind::isotropic; }
 
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
         srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-        srec.pdf_ptr = std::make_shared<sphere_pdf>();
+        srec.pdf_ptr = srec.pdf_store.emplace<sphere_pdf>();
         srec.skip_pdf = false;
         return true;
     }
@@ -205,4 +218,54 @@ private:
     std::shared_ptr<texture> tex;
 };
 
-#endif
\ No newline at end of file
+template <typename visitor>
+auto visit_material(const material& m, visitor&& f) {
+    // Switches on the material tag and hands `f` the concrete material type, so that calls made
+    // through it can be resolved statically (and inlined) for the built-in materials.
+    switch (m.kind()) {
+        case material_kind::lambertian:    return f(static_cast<const lambertian&>(m));
+        case material_kind::metal:         return f(static_cast<const metal&>(m));
+        case material_kind::ceramic:       return f(static_cast<const ceramic&>(m));
+        case material_kind::dielectric:    return f(static_cast<const dielectric&>(m));
+        case material_kind::diffuse_light: return f(static_cast<const diffuse_light&>(m));
+        case material_kind::isotropic:     return f(static_cast<const isotropic&>(m));
+        default:                           return f(m);
+    }
+}
+
+// Non-virtual entry points used by the renderer. The qualified calls bypass the vtable for the
+// built-in types; anything else goes through the virtual functions as usual.
+
+inline color emitted(const material& m, const ray& r_in, const hit_record& rec) {
+    return visit_material(m, [&](const auto& mat) {
+        using type = std::decay_t<decltype(mat)>;
+        if constexpr (std::is_same_v<type, material>)
+            return mat.emitted(r_in, rec, rec.u, rec.v, rec.p);
+        else
+            return mat.type::emitted(r_in, rec, rec.u, rec.v, rec.p);
+    });
+}
+
+inline bool scatter(const material& m, const ray& r_in, const hit_record& rec, scatter_record& srec) {
+    return visit_material(m, [&](const auto& mat) {
+        using type = std::decay_t<decltype(mat)>;
+        if constexpr (std::is_same_v<type, material>)
+            return mat.scatter(r_in, rec, srec);
+        else
+            return mat.type::scatter(r_in, rec, srec);
+    });
+}
+
+inline double scattering_pdf(
+    const material& m, const ray& r_in, const hit_record& rec, const ray& scattered)
+{
+    return visit_material(m, [&](const auto& mat) {
+        using type = std::decay_t<decltype(mat)>;
+        if constexpr (std::is_same_v<type, material>)
+            return mat.scattering_pdf(r_in, rec, scattered);
+        else
+            return mat.type::scattering_pdf(r_in, rec, scattered);
+    });
+}
+
+#endif
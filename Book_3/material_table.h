@@ -0,0 +1,49 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include "material.h"
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+// Closed set of the built-in materials, stored by value.
+using material_variant =
+    std::variant<lambertian, metal, ceramic, dielectric, diffuse_light, isotropic>;
+
+class material_table {
+  // Keeps the materials of a scene side by side in one array instead of one heap block each.
+  // add() returns a shared_ptr that points into the table (and keeps the whole table alive), so
+  // the result is passed to hittables like any other material; the renderer then shades it via
+  // visit_material() without virtual calls.
+  public:
+    material_table(size_t capacity)
+      : entries(std::make_shared<std::vector<material_variant>>())
+    {
+        // Entries must never move once handed out, so the capacity is fixed up front.
+        entries->reserve(capacity);
+    }
+
+    template <typename material_type, typename... Args>
+    std::shared_ptr<material> add(Args&&... args) {
+        if (entries->size() == entries->capacity()) {
+            std::cerr << "WARNING: material table full (" << entries->capacity()
+                      << " entries); allocating material separately.\n";
+            return std::make_shared<material_type>(std::forward<Args>(args)...);
+        }
+
+        entries->emplace_back(std::in_place_type<material_type>, std::forward<Args>(args)...);
+        return std::shared_ptr<material>(entries, &std::get<material_type>(entries->back()));
+    }
+
+    size_t size() const { return entries->size(); }
+
+    const material_variant& operator[](size_t index) const { return (*entries)[index]; }
+
+  private:
+    std::shared_ptr<std::vector<material_variant>> entries;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef MLT_INTEGRATOR_H
+#define MLT_INTEGRATOR_H
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "path_tracer.h"
+#include "alias_table.h"
+#include "light_list.h"
+#include "pss_sampler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+class mlt_integrator {
+  // integrator_type::mlt: primary-sample-space Metropolis light transport (PSSMLT). Markov
+  // chains mutate the numbers that nee_mis paths consume, spending samples where the image is
+  // bright.
+  public:
+    mlt_integrator(const camera& cam, const path_tracer& tracer) : cam(cam), tracer(tracer) {}
+
+    void render(
+        const hittable& world, const hittable& lights,
+        std::vector<std::vector<color>>& pixel_buffer
+    ) const {
+        // Bootstrap: independent paths estimate the image's mean luminance b, the normalization
+        // of the chains, and are kept as a distribution of starting points so that each chain
+        // starts in proportion to its path's luminance (no start-up bias). The chains then take
+        // samples_per_pixel mutations per pixel between them; every step adds both the proposal
+        // and the current path, weighted by the acceptance probability (Veach's expected values),
+        // so rejected proposals still contribute. Pixel values are b * splats / mutations per
+        // pixel.
+        const double sigma = 0.01;
+        const std::uint64_t chain_seed_offset = 0x9e3779b97f4a7c15ull;
+
+        int bootstrap = std::max(1, cam.mlt_bootstrap_samples);
+        std::vector<double> weights(bootstrap);
+        #pragma omp parallel for schedule(dynamic, 256)
+        for (int k = 0; k < bootstrap; k++) {
+            pss_sampler pss(k, sigma, cam.mlt_large_step);
+            int x, y;
+            weights[k] = light_list::luminance(mlt_path(pss, world, lights, x, y));
+        }
+
+        double b = 0;
+        for (auto weight : weights)
+            b += weight;
+        b /= bootstrap;
+        if (!(b > 0)) {
+            std::cerr << "WARNING: mlt bootstrap paths found no light; the image is black.\n";
+            return;
+        }
+        alias_table starts(weights);
+
+        int chains = std::max(1, omp_get_max_threads() * std::max(1, cam.mlt_chains_per_thread));
+        auto total_mutations =
+            std::int64_t(cam.image_width) * cam.image_height * cam.samples_per_pixel;
+        std::vector<color> splats(cam.image_width * cam.image_height, color(0,0,0));
+        std::atomic<int> chains_left(chains);
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int c = 0; c < chains; c++) {
+            auto mutations = total_mutations / chains + (c < total_mutations % chains ? 1 : 0);
+            std::mt19937_64 rng(chain_seed_offset + c);
+            auto uniform = [&rng]() { return (rng() >> 11) * 0x1.0p-53; };
+
+            // Replays the chosen bootstrap path: same seed, same numbers.
+            auto start = starts.sample(uniform());
+            pss_sampler pss(start, sigma, cam.mlt_large_step);
+            int x, y;
+            color current = mlt_path(pss, world, lights, x, y);
+            auto current_f = light_list::luminance(current);
+
+            for (std::int64_t m = 0; m < mutations; m++) {
+                pss.start_iteration();
+                int proposed_x, proposed_y;
+                color proposed = mlt_path(pss, world, lights, proposed_x, proposed_y);
+                auto proposed_f = light_list::luminance(proposed);
+
+                auto accept = (current_f > 0) ? std::fmin(1.0, proposed_f / current_f) : 1.0;
+                if (!(accept >= 0))
+                    accept = 0;  // NaN radiance
+                if (accept > 0)
+                    cam.add_splat(splats, proposed_x, proposed_y, proposed * (accept / proposed_f));
+                if (accept < 1)
+                    cam.add_splat(splats, x, y, current * ((1 - accept) / current_f));
+
+                if (uniform() < accept) {
+                    current = proposed;
+                    current_f = proposed_f;
+                    x = proposed_x;
+                    y = proposed_y;
+                    pss.accept();
+                } else {
+                    pss.reject();
+                }
+            }
+
+            // Only one thread should update the progress bar
+            #pragma omp critical
+            std::clog << "\rChains remaining: " << --chains_left << ' ' << std::flush;
+        }
+
+        auto scale = b * cam.image_width * cam.image_height / double(total_mutations);
+        for (int j = 0; j < cam.image_height; j++)
+            for (int i = 0; i < cam.image_width; i++)
+                pixel_buffer[j][i] = scale * splats[j*cam.image_width + i];
+    }
+
+  private:
+    const camera& cam;
+    const path_tracer& tracer;
+
+    color mlt_path(
+        pss_sampler& pss, const hittable& world, const hittable& lights, int& x, int& y
+    ) const {
+        // Radiance of the nee_mis path that the numbers of `pss` describe; the first two pick
+        // the point on the film, returned as pixel (x, y).
+        sample_source_scope scope(pss);
+
+        auto px = random_double() * cam.image_width;
+        auto py = random_double() * cam.image_height;
+        x = std::min(int(px), cam.image_width - 1);
+        y = std::min(int(py), cam.image_height - 1);
+
+        return tracer.ray_color_mis(cam.film_ray(px, py), cam.max_depth, world, lights, -1);
+    }
+};
+
+#endif
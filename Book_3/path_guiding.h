@@ -0,0 +1,326 @@
+#ifndef PATH_GUIDING_H
+#define PATH_GUIDING_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "pdf.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+class d_tree {
+  // Directional quadtree over the sphere, in the equal-area map (phi, cos theta) -> [0,1)^2,
+  // so a uniform point in any cell is a uniform direction within it. Every node keeps the
+  // energy recorded in each of its four quadrants; sampling and pdf evaluation descend the tree
+  // choosing quadrants in proportion to that energy.
+  public:
+    d_tree() : nodes(1) {}
+
+    void record(const vec3& direction, double value) {
+        // Adds a (non-negative) radiance estimate arriving from the unit `direction`. Safe to
+        // call from several threads at once.
+        double x, y;
+        to_square(direction, x, y);
+
+        std::uint32_t index = 0;
+        while (true) {
+            int q = quadrant(x, y);
+            #pragma omp atomic
+            nodes[index].energy[q] += value;
+            if (nodes[index].child[q] == 0)
+                return;
+            index = nodes[index].child[q];
+        }
+    }
+
+    double total() const {
+        const auto& root = nodes[0];
+        return root.energy[0] + root.energy[1] + root.energy[2] + root.energy[3];
+    }
+
+    double value(const vec3& direction) const {
+        // Density over solid angle of sample() at the unit `direction`.
+        double x, y;
+        to_square(direction, x, y);
+
+        double density = 1;
+        std::uint32_t index = 0;
+        while (true) {
+            const auto& n = nodes[index];
+            auto sum = n.energy[0] + n.energy[1] + n.energy[2] + n.energy[3];
+            if (sum <= 0)
+                break;  // Nothing recorded below: uniform over the cell
+
+            int q = quadrant(x, y);
+            density *= 4 * n.energy[q] / sum;
+            if (n.child[q] == 0 || density == 0)
+                break;
+            index = n.child[q];
+        }
+
+        return density / (4*pi);
+    }
+
+    vec3 sample() const {
+        double x0 = 0, y0 = 0, size = 1;
+
+        std::uint32_t index = 0;
+        while (true) {
+            const auto& n = nodes[index];
+            auto sum = n.energy[0] + n.energy[1] + n.energy[2] + n.energy[3];
+            if (sum <= 0)
+                break;
+
+            auto pick = random_double() * sum;
+            int q = 0;
+            while (q < 3 && (pick -= n.energy[q]) >= 0)
+                q++;
+            while (n.energy[q] <= 0)  // Rounding can land on an empty quadrant
+                q = (q + 3) % 4;
+
+            size /= 2;
+            x0 += (q & 1) ? size : 0;
+            y0 += (q & 2) ? size : 0;
+            if (n.child[q] == 0)
+                break;
+            index = n.child[q];
+        }
+
+        return from_square(x0 + random_double()*size, y0 + random_double()*size);
+    }
+
+    d_tree refined(double fraction, int max_depth) const {
+        // Tree for the next pass: quadrants holding more than `fraction` of the energy are
+        // subdivided (new children assume the energy spreads evenly), the others collapse to
+        // leaves. Energies of the result are zero.
+        d_tree result;
+        auto sum = total();
+        if (sum > 0)
+            refine_node(result, 0, 0, sum * fraction, 1, max_depth);
+        return result;
+    }
+
+    size_t node_count() const { return nodes.size(); }
+
+    size_t memory_bytes() const { return nodes.size() * sizeof(node); }
+
+  private:
+    struct node {
+        double energy[4] = { 0, 0, 0, 0 };
+        std::uint32_t child[4] = { 0, 0, 0, 0 };  // 0: the quadrant is a leaf
+    };
+
+    std::vector<node> nodes;
+
+    void refine_node(d_tree& result, std::uint32_t from, std::uint32_t to, double threshold,
+                     int depth, int max_depth) const {
+        // Builds the children of result node `to` from the quadrants of old node `from`.
+        for (int q = 0; q < 4; q++) {
+            auto energy = nodes[from].energy[q];
+            if (energy <= threshold || depth >= max_depth)
+                continue;
+
+            auto index = std::uint32_t(result.nodes.size());
+            result.nodes.emplace_back();
+            result.nodes[to].child[q] = index;
+
+            if (nodes[from].child[q] != 0) {
+                refine_node(result, nodes[from].child[q], index, threshold, depth + 1, max_depth);
+            } else {
+                // A leaf quadrant: split its energy evenly over the four new quadrants.
+                refine_leaf(result, index, energy / 4, threshold, depth + 1, max_depth);
+            }
+        }
+    }
+
+    static void refine_leaf(d_tree& result, std::uint32_t to, double quarter, double threshold,
+                            int depth, int max_depth) {
+        if (quarter <= threshold || depth >= max_depth)
+            return;
+        for (int q = 0; q < 4; q++) {
+            auto index = std::uint32_t(result.nodes.size());
+            result.nodes.emplace_back();
+            result.nodes[to].child[q] = index;
+            refine_leaf(result, index, quarter / 4, threshold, depth + 1, max_depth);
+        }
+    }
+
+    static int quadrant(double& x, double& y) {
+        // Quadrant of (x, y) in [0,1)^2, rescaling the point into that quadrant.
+        int q = 0;
+        x *= 2;
+        y *= 2;
+        if (x >= 1) { q |= 1; x -= 1; }
+        if (y >= 1) { q |= 2; y -= 1; }
+        return q;
+    }
+
+    static void to_square(const vec3& d, double& x, double& y) {
+        auto phi = std::atan2(d.z(), d.x());
+        x = std::fmin(std::fmax((phi < 0 ? phi + 2*pi : phi) / (2*pi), 0.0), 1 - 1e-12);
+        y = std::fmin(std::fmax((d.y() + 1) / 2, 0.0), 1 - 1e-12);
+    }
+
+    static vec3 from_square(double x, double y) {
+        auto cos_theta = 2*y - 1;
+        auto sin_theta = std::sqrt(std::fmax(0, 1 - cos_theta*cos_theta));
+        auto phi = 2*pi*x;
+        return vec3(sin_theta * std::cos(phi), cos_theta, sin_theta * std::sin(phi));
+    }
+};
+
+class guided_pdf : public pdf {
+  // Directions distributed as the incident light learned by a d_tree, folded onto the side of
+  // the surface that `normal` points to: a spatial leaf spans surfaces facing many ways, and
+  // a direction behind the surface would only be wasted.
+  public:
+    guided_pdf(const d_tree& tree, const vec3& normal) : tree(tree), normal(normal) {}
+
+    double value(const vec3& direction) const override {
+        auto d = unit_vector(direction);
+        auto cosine = dot(d, normal);
+        if (cosine < 0)
+            return 0;
+        return tree.value(d) + tree.value(d - 2*cosine*normal);
+    }
+
+    vec3 generate() const override {
+        auto d = tree.sample();
+        auto cosine = dot(d, normal);
+        return (cosine < 0) ? d - 2*cosine*normal : d;
+    }
+
+  private:
+    const d_tree& tree;
+    vec3 normal;
+};
+
+class path_guide {
+  // Spatial-directional tree (SD-tree, after Muller et al. 2017) learning the light arriving
+  // at every point of the scene over progressive render passes. A binary tree halves the scene
+  // bounds along alternating axes; each of its leaves holds one d_tree that paths sample from
+  // during a pass and another that collects their radiance. Between passes refine() splits the
+  // busiest leaves and swaps in the collected trees, so the guide tightens as samples double.
+  public:
+    bool collecting = true;  // Whether record() stores anything
+
+    path_guide(const aabb& bounds) : bounds(bounds) {
+        nodes.push_back({ 0, 0, 0, 0 });
+        leaves.emplace_back();
+    }
+
+    const d_tree* sampling_tree(const point3& p) const {
+        // Learned distribution around p, or null while nothing has been learned there.
+        const auto& tree = leaves[leaf_index(p)].sampling;
+        return tree.total() > 0 ? &tree : nullptr;
+    }
+
+    void record(const point3& p, const vec3& direction, double value) {
+        // Every call counts towards splitting the leaf, including those bringing no light.
+        if (!collecting || !(value >= 0) || value == infinity)
+            return;
+        auto& leaf = leaves[leaf_index(p)];
+        if (value > 0)
+            leaf.building.record(unit_vector(direction), value);
+        #pragma omp atomic
+        leaf.samples += 1;
+    }
+
+    void refine(int pass) {
+        // Called between passes, with no paths in flight. Spatial leaves that took more than
+        // c * sqrt(2^pass) samples are split; then every leaf samples what it collected and
+        // collects into a refined copy.
+        auto threshold = spatial_threshold * std::sqrt(std::pow(2.0, pass));
+        for (std::uint32_t i = 0, n = std::uint32_t(nodes.size()); i < n; i++) {
+            if (nodes[i].child == 0)
+                split(i, threshold);
+        }
+
+        for (auto& leaf : leaves) {
+            leaf.sampling = leaf.building;
+            leaf.building = leaf.sampling.refined(directional_fraction, max_directional_depth);
+            leaf.samples = 0;
+        }
+    }
+
+    size_t spatial_leaves() const { return leaves.size(); }
+
+    size_t directional_nodes() const {
+        size_t count = 0;
+        for (const auto& leaf : leaves)
+            count += leaf.sampling.node_count() + leaf.building.node_count();
+        return count;
+    }
+
+    size_t memory_bytes() const {
+        size_t bytes = nodes.size() * sizeof(s_node) + leaves.size() * sizeof(leaf_data);
+        for (const auto& leaf : leaves)
+            bytes += leaf.sampling.memory_bytes() + leaf.building.memory_bytes();
+        return bytes;
+    }
+
+  private:
+    struct s_node {
+        std::uint32_t child;  // Index of the first of two children; 0 for a leaf
+        std::uint32_t leaf;   // Leaf: index into `leaves`
+        int axis;             // Axis halved at this node (for a leaf: once it splits)
+        int depth;
+    };
+
+    struct leaf_data {
+        d_tree sampling, building;
+        double samples = 0;
+    };
+
+    static constexpr double spatial_threshold = 12000;
+    static constexpr double directional_fraction = 0.01;
+    static constexpr int max_directional_depth = 20;
+    static constexpr int max_spatial_depth = 48;
+
+    aabb bounds;
+    std::vector<s_node> nodes;
+    std::vector<leaf_data> leaves;
+
+    std::uint32_t leaf_index(const point3& p) const {
+        double lo[3] = { bounds.x.min, bounds.y.min, bounds.z.min };
+        double hi[3] = { bounds.x.max, bounds.y.max, bounds.z.max };
+
+        std::uint32_t index = 0;
+        while (nodes[index].child != 0) {
+            auto axis = nodes[index].axis;
+            auto mid = (lo[axis] + hi[axis]) / 2;
+            if (p[axis] < mid) {
+                hi[axis] = mid;
+                index = nodes[index].child;
+            } else {
+                lo[axis] = mid;
+                index = nodes[index].child + 1;
+            }
+        }
+        return nodes[index].leaf;
+    }
+
+    void split(std::uint32_t index, double threshold) {
+        auto leaf = nodes[index].leaf;
+        auto depth = nodes[index].depth;
+        if (leaves[leaf].samples <= threshold || depth >= max_spatial_depth)
+            return;
+
+        // Both halves start from a copy of the parent's trees and half its sample count.
+        auto child = std::uint32_t(nodes.size());
+        auto second_leaf = std::uint32_t(leaves.size());
+        leaves[leaf].samples /= 2;
+        leaves.push_back(leaves[leaf]);
+
+        auto next_axis = (nodes[index].axis + 1) % 3;
+        nodes[index].child = child;
+        nodes.push_back({ 0, leaf, next_axis, depth + 1 });
+        nodes.push_back({ 0, second_leaf, next_axis, depth + 1 });
+
+        split(child, threshold);
+        split(child + 1, threshold);
+    }
+};
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef PATH_TRACER_H
+#define PATH_TRACER_H
+
+#include "rtweekend.h"
+#include "environment_light.h"
+#include "hittable.h"
+#include "irradiance_cache.h"
+#include "light_list.h"
+#include "material.h"
+#include "onb.h"
+#include "path_guiding.h"
+#include "pdf.h"
+#include "photon_map.h"
+#include <atomic>
+#include <memory>
+#include <omp.h>
+#include <vector>
+
+
+class path_tracer {
+  // Radiance along a ray by unidirectional path tracing, shared by the integrators. ray_color()
+  // follows one direction from a 50/50 mix of the light and material pdfs (mixture);
+  // ray_color_mis() takes a light sample and a material sample at every non-specular vertex
+  // and combines them by MIS (nee_mis), and the other integrators build on it. The irradiance
+  // cache, caustic map and path guide are optional and change how ray_color_mis() treats
+  // diffuse vertices and samples materials.
+  public:
+    int    max_depth = 10;                        // Maximum number of ray bounces into scene
+    color  background;                            // Scene background color
+    std::shared_ptr<environment_light> environment;  // Image lighting, if any, seen by rays that
+                                                     // leave the scene instead of the background
+    int    irradiance_gather_rays = 64;           // Hemisphere rays traced for each cache record
+    irradiance_cache* cache = nullptr;            // Irradiance records, with irradiance caching
+    const photon_map* caustics = nullptr;         // Caustic photons, with a caustic map
+    path_guide* guide = nullptr;                  // Learned incident light, while guiding
+
+    color ray_color(const ray& r, int depth, const hittable& world, const hittable& lights)
+    const {
+        // If we've exceeded the ray bounce limit, no more light is gathered.
+        if (depth <= 0)
+            return color(0,0,0);
+
+        hit_record rec; // Declare rec here
+
+        // If the ray hits nothing, return the background color.
+        if (!world.hit(r, interval(0.001, infinity), rec))
+            return escaped_radiance(r);
+
+        scatter_record srec;
+        color color_from_emission = emitted(*rec.mat, r, rec);
+
+        if (!scatter(*rec.mat, r, rec, srec))
+            return color_from_emission;
+
+        if (srec.skip_pdf) {
+            return srec.attenuation * ray_color(srec.skip_pdf_ray, depth-1, world, lights);
+        }
+
+        hittable_pdf light_pdf(lights, rec.p);
+        mixture_pdf p(light_pdf, *srec.pdf_ptr);
+
+        ray scattered = ray(rec.p, p.generate(), r.time());
+        auto pdf_value = p.value(scattered.direction());
+
+        double scatter_pdf = scattering_pdf(*rec.mat, r, rec, scattered);
+
+        color sample_color = ray_color(scattered, depth-1, world, lights);
+        color color_from_scatter =
+            (srec.attenuation * scatter_pdf * sample_color) / pdf_value;
+
+        return color_from_emission + color_from_scatter;
+    }
+
+    color ray_color_mis(
+        const ray& r, int depth, const hittable& world, const hittable& lights,
+        double material_pdf, bool use_cache = true, bool caustic_gathered = false
+    ) const {
+        // Next-event estimation with multiple importance sampling. `material_pdf` is the density
+        // with which the previous vertex sampled `r` from its material, or negative when the
+        // ray comes from the camera or a specular bounce, where no light sample was taken and
+        // emission counts in full. An infinite `material_pdf` marks a vertex whose direct light
+        // came from light samples alone (restir), so only emitters they cannot reach count.
+        // With an irradiance cache, diffuse vertices reached from another non-specular vertex
+        // end the path on cached irradiance, unless `use_cache` is off (while filling it).
+        // With a caustic map, diffuse vertices add the caustic light it estimates, and mark
+        // their continuation `caustic_gathered` so that the emitters it reaches through the
+        // same kind of specular bounces as the photons are not counted twice.
+        if (depth <= 0)
+            return color(0,0,0);
+
+        hit_record rec;
+        if (!world.hit(r, interval(0.001, infinity), rec)) {
+            // The environment is a light as well; restir's candidates never sample it, though.
+            color sky = escaped_radiance(r);
+            if (environment && material_pdf >= 0 && material_pdf != infinity)
+                sky *= power_heuristic(material_pdf, lights.pdf_value(r.origin(), r.direction()));
+            return sky;
+        }
+
+        color color_from_emission = emitted(*rec.mat, r, rec);
+        if (caustic_gathered && material_pdf < 0)
+            color_from_emission = color(0,0,0);
+        else if (material_pdf >= 0 && !color_from_emission.near_zero()) {
+            // The previous vertex could also have reached this emitter with its light sample.
+            auto light_pdf = lights.pdf_value(r.origin(), r.direction());
+            if (material_pdf == infinity)
+                color_from_emission *= (light_pdf > 0) ? 0 : 1;
+            else
+                color_from_emission *= power_heuristic(material_pdf, light_pdf);
+        }
+
+        scatter_record srec;
+        if (!scatter(*rec.mat, r, rec, srec))
+            return color_from_emission;
+
+        if (srec.skip_pdf) {
+            return color_from_emission
+                 + srec.attenuation
+                 * ray_color_mis(srec.skip_pdf_ray, depth-1, world, lights, -1, use_cache,
+                                 caustic_gathered && forms_caustics(*rec.mat));
+        }
+
+        bool gathers_caustics = caustics && is_diffuse(*rec.mat);
+        if (gathers_caustics)
+            color_from_emission += srec.attenuation * caustics->estimate(rec.p, rec.normal) / pi;
+
+        if (cache && use_cache && material_pdf >= 0 && is_diffuse(*rec.mat)) {
+            return color_from_emission
+                 + srec.attenuation * cached_irradiance(rec, r.time(), depth, world, lights) / pi;
+        }
+
+        // With a guide, the material sample comes half of the time from the learned incident
+        // light instead; MIS and the path weight then use the density of that mixture.
+        const d_tree* guide_tree = guide ? guide->sampling_tree(rec.p) : nullptr;
+        guided_pdf learned_pdf(guide_tree ? *guide_tree : empty_guide_tree(), rec.normal);
+        mixture_pdf guided_mixture(learned_pdf, *srec.pdf_ptr);
+        const pdf& material_sampler =
+            guide_tree ? static_cast<const pdf&>(guided_mixture) : *srec.pdf_ptr;
+
+        // Light sample: trace a shadow ray towards a point chosen by the light pdf, and keep
+        // the emission it reaches.
+        color color_from_lights(0,0,0);
+        hittable_pdf light_pdf(lights, rec.p);
+        ray to_light(rec.p, light_pdf.generate(), r.time());
+        auto light_value = light_pdf.value(to_light.direction());
+
+        hit_record light_rec;
+        if (light_value > 0) {
+            color light_emission = world.hit(to_light, interval(0.001, infinity), light_rec)
+                                 ? emitted(*light_rec.mat, to_light, light_rec)
+                                 : environment_light_radiance(to_light);
+            auto scatter_value = scattering_pdf(*rec.mat, r, rec, to_light);
+            if (!light_emission.near_zero() && scatter_value > 0) {
+                auto weight = power_heuristic(light_value, material_sampler.value(to_light.direction()));
+                color_from_lights =
+                    weight * srec.attenuation * scatter_value * light_emission / light_value;
+            }
+        }
+
+        // Material sample: continue the path, weighting any emitter it hits on arrival.
+        ray scattered(rec.p, material_sampler.generate(), r.time());
+        auto pdf_value = material_sampler.value(scattered.direction());
+        if (pdf_value <= 0)
+            return color_from_emission + color_from_lights;
+
+        auto scatter_pdf = scattering_pdf(*rec.mat, r, rec, scattered);
+        color color_from_scatter(0,0,0);
+        if (scatter_pdf > 0) {
+            color sample_color =
+                ray_color_mis(scattered, depth-1, world, lights, pdf_value, use_cache,
+                              gathers_caustics);
+            color_from_scatter = (srec.attenuation * scatter_pdf * sample_color) / pdf_value;
+            if (guide)
+                guide->record(rec.p, scattered.direction(),
+                              light_list::luminance(sample_color) / pdf_value);
+        }
+
+        return color_from_emission + color_from_lights + color_from_scatter;
+    }
+
+    color escaped_radiance(const ray& r) const {
+        // Light arriving along a ray that leaves the scene.
+        return environment ? environment->radiance(r.direction()) : background;
+    }
+
+    color environment_light_radiance(const ray& r) const {
+        // What a light sample that leaves the scene reaches: the environment, if any. A plain
+        // background is not among the lights, so only material samples may count it.
+        return environment ? environment->radiance(r.direction()) : color(0,0,0);
+    }
+
+    std::unique_ptr<photon_map> trace_caustics(
+        const hittable& world, const hittable& lights, int photon_count, double radius
+    ) const {
+        // Traces photons out of the lights and keeps those that land on a diffuse surface after
+        // one or more bounces through caustic-forming materials and nothing else: the caustic
+        // paths, which path tracing only finds by chance since light samples cannot pass
+        // through specular surfaces.
+        // Each of the `photon_count` photons leaves a point chosen on the lights with a
+        // cosine-distributed direction and carries Le * pi / (pdf * N) of the emitted power.
+        // A `radius` of 0 gathers within 0.25% of the scene's extent.
+        std::vector<std::vector<photon>> stored(omp_get_max_threads());
+        std::atomic<bool> unsampled(false);
+
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (int k = 0; k < photon_count; k++) {
+            surface_sample s;
+            if (!lights.sample_surface(s) || !s.mat || s.pdf <= 0) {
+                // The environment has no surface to send photons from.
+                unsampled = unsampled || !environment;
+                continue;
+            }
+
+            onb uvw(s.normal);
+            ray r(s.p, uvw.transform(random_cosine_direction()), random_double());
+
+            hit_record light_rec;
+            light_rec.p = s.p;
+            light_rec.u = s.u;
+            light_rec.v = s.v;
+            light_rec.mat = s.mat;
+            light_rec.front_face = true;
+            light_rec.normal = s.normal;
+            color power = emitted(*s.mat, r, light_rec) * pi / (s.pdf * photon_count);
+
+            bool specular = false;
+            for (int depth = max_depth; depth > 0 && !power.near_zero(); depth--) {
+                hit_record rec;
+                scatter_record srec;
+                if (!world.hit(r, interval(0.001, infinity), rec) || !scatter(*rec.mat, r, rec, srec))
+                    break;
+
+                if (!srec.skip_pdf) {
+                    if (specular && is_diffuse(*rec.mat))
+                        stored[omp_get_thread_num()].push_back(
+                            { rec.p, unit_vector(r.direction()), power });
+                    break;
+                }
+                if (!forms_caustics(*rec.mat))
+                    break;
+
+                specular = true;
+                power = power * srec.attenuation;
+                r = srec.skip_pdf_ray;
+            }
+        }
+
+        if (unsampled) {
+            std::cerr << "WARNING: caustic photons need lights that can be sampled by area and "
+                         "carry their emissive material; the caustic map is incomplete.\n";
+        }
+
+        std::vector<photon> photons;
+        for (auto& thread_photons : stored)
+            photons.insert(photons.end(), thread_photons.begin(), thread_photons.end());
+        if (photons.empty())
+            return nullptr;
+
+        if (radius <= 0) {
+            auto bounds = world.bounding_box();
+            radius = 0.0025 * vec3(bounds.x.size(), bounds.y.size(), bounds.z.size()).length();
+        }
+        return std::make_unique<photon_map>(std::move(photons), radius);
+    }
+
+    static double power_heuristic(double pdf, double other_pdf) {
+        // MIS weight (power heuristic, beta = 2) of a sample drawn with `pdf` when `other_pdf`
+        // could also have produced it.
+        auto a = pdf * pdf;
+        auto b = other_pdf * other_pdf;
+        return (a + b > 0) ? a / (a + b) : 0;
+    }
+
+    static bool is_diffuse(const material& m) {
+        // Materials whose reflected light is attenuation * irradiance / pi.
+        return m.kind() == material_kind::lambertian || m.kind() == material_kind::ceramic;
+    }
+
+    static bool forms_caustics(const material& m) {
+        // Specular materials that photons and light subpaths may pass through. They have to
+        // scatter light the same way in both directions, so that paths traced from the lights
+        // carry what paths from the camera would gather; fuzzy metal does not, since which of
+        // its reflections fall below the surface depends on the incoming direction.
+        return m.kind() == material_kind::dielectric;
+    }
+
+  private:
+    color cached_irradiance(
+        const hit_record& rec, double time, int depth, const hittable& world,
+        const hittable& lights
+    ) const {
+        // Irradiance at a diffuse hit, interpolated from the cache, or gathered over the
+        // hemisphere and stored when no record is valid there.
+        color irradiance;
+        if (cache->lookup(rec.p, rec.normal, irradiance))
+            return irradiance;
+
+        // Each gather pairs a light sample with a cosine-distributed ray, weighted by MIS as
+        // in ray_color_mis. Hit distances of the rays give the record's validity radius.
+        cosine_pdf gather_pdf(rec.normal);
+        hittable_pdf light_pdf(lights, rec.p);
+        color sum(0,0,0);
+        double inverse_distance_sum = 0;
+
+        for (int k = 0; k < irradiance_gather_rays; k++) {
+            ray to_light(rec.p, light_pdf.generate(), time);
+            auto light_value = light_pdf.value(to_light.direction());
+            auto light_cosine = dot(rec.normal, unit_vector(to_light.direction()));
+            hit_record light_rec;
+            if (light_value > 0 && light_cosine > 0) {
+                color light_emission = world.hit(to_light, interval(0.001, infinity), light_rec)
+                                     ? emitted(*light_rec.mat, to_light, light_rec)
+                                     : environment_light_radiance(to_light);
+                auto weight = power_heuristic(light_value, light_cosine / pi);
+                sum += weight * light_emission * light_cosine / light_value;
+            }
+
+            ray gather(rec.p, gather_pdf.generate(), time);
+            auto cosine = dot(rec.normal, unit_vector(gather.direction()));
+            if (cosine <= 0)
+                continue;
+
+            hit_record gather_rec;
+            if (world.hit(gather, interval(0.001, infinity), gather_rec))
+                inverse_distance_sum += 1 / (gather_rec.t * gather.direction().length());
+
+            // L cos / (cos / pi)
+            sum += pi * ray_color_mis(gather, depth-1, world, lights, cosine / pi, false,
+                                      caustics != nullptr);
+        }
+
+        irradiance = sum / irradiance_gather_rays;
+        auto harmonic_distance =
+            inverse_distance_sum > 0 ? irradiance_gather_rays / inverse_distance_sum : infinity;
+        cache->insert(rec.p, rec.normal, irradiance, harmonic_distance);
+        return irradiance;
+    }
+
+    static const d_tree& empty_guide_tree() {
+        static const d_tree tree;
+        return tree;
+    }
+};
+
+#endif
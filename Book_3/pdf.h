@@ -9,6 +9,10 @@
 #include "hittable_list.h"
 #include "camera.h"
 #include <cmath>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 
 class pdf {
@@ -57,9 +61,10 @@ class hittable_pdf : public pdf {
 
 class mixture_pdf : public pdf {
   public:
-    mixture_pdf(std::shared_ptr<pdf> p0, std::shared_ptr<pdf> p1) {
-        p[0] = p0;
-        p[1] = p1;
+    // The mixture only refers to its two components, which must outlive it.
+    mixture_pdf(const pdf& p0, const pdf& p1) {
+        p[0] = &p0;
+        p[1] = &p1;
     }
 
     double value(const vec3& direction) const override {
@@ -74,7 +79,7 @@ class mixture_pdf : public pdf {
     }
 
   private:
-    std::shared_ptr<pdf> p[2];
+    const pdf* p[2];
 };
 
 class sphere_pdf : public pdf {
@@ -90,4 +95,39 @@ class sphere_pdf : public pdf {
     }
 };
 
-#endif
\ No newline at end of file
+
+class pdf_storage {
+  // In-place storage for the one pdf a material hands back from scatter(), so that choosing a
+  // scattering distribution never touches the heap. Any pdf type that fits the buffer can be
+  // constructed in it; constructing another one destroys the previous occupant.
+  public:
+    pdf_storage() {}
+    pdf_storage(const pdf_storage&) = delete;
+    pdf_storage& operator=(const pdf_storage&) = delete;
+    ~pdf_storage() { clear(); }
+
+    template <typename pdf_type, typename... Args>
+    const pdf* emplace(Args&&... args) {
+        static_assert(std::is_base_of<pdf, pdf_type>::value, "pdf_storage only holds pdfs");
+        static_assert(sizeof(pdf_type) <= capacity, "pdf type too large for pdf_storage");
+        static_assert(alignof(pdf_type) <= alignof(std::max_align_t), "pdf type over-aligned");
+
+        clear();
+        stored = new (buffer) pdf_type(std::forward<Args>(args)...);
+        return stored;
+    }
+
+    void clear() {
+        if (stored)
+            stored->~pdf();
+        stored = nullptr;
+    }
+
+  private:
+    static constexpr size_t capacity = 128;
+
+    alignas(std::max_align_t) unsigned char buffer[capacity];
+    pdf* stored = nullptr;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef PHOTON_MAP_H
+#define PHOTON_MAP_H
+
+#include "rtweekend.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+struct photon {
+    // Light flux deposited on a surface, arriving along `direction`.
+    point3 p;
+    vec3 direction;
+    color power;
+};
+
+class photon_map {
+  // Photons stored for density estimation with a fixed gather radius (Jensen 1996), in a hashed
+  // grid of cells twice the radius wide: a gather disc centred anywhere in a cell only reaches
+  // that cell's neighbours on the side of the centre, so every lookup visits eight cells.
+  // Photons of a cell are contiguous, laid out by a counting sort over the hash buckets.
+  public:
+    photon_map(std::vector<photon> photons, double radius)
+      : photons(std::move(photons)), radius(radius), cell_size(2 * radius)
+    {
+        std::size_t buckets = 1;
+        while (buckets < 2 * this->photons.size())
+            buckets <<= 1;
+        mask = buckets - 1;
+
+        std::vector<std::uint32_t> keys(this->photons.size());
+        bucket_start.assign(buckets + 1, 0);
+        for (std::size_t i = 0; i < this->photons.size(); i++) {
+            const auto& p = this->photons[i].p;
+            keys[i] = bucket(cell(p.x()), cell(p.y()), cell(p.z()));
+            bucket_start[keys[i] + 1]++;
+        }
+        for (std::size_t b = 0; b < buckets; b++)
+            bucket_start[b + 1] += bucket_start[b];
+
+        std::vector<photon> sorted(this->photons.size());
+        auto next = bucket_start;
+        for (std::size_t i = 0; i < this->photons.size(); i++)
+            sorted[next[keys[i]]++] = this->photons[i];
+        this->photons.swap(sorted);
+    }
+
+    std::size_t size() const { return photons.size(); }
+
+    color estimate(const point3& p, const vec3& normal) const {
+        // Irradiance at p on a surface with unit `normal`: the power of the photons within the
+        // radius that arrived on the front side, over the area of the gather disc. Photons far
+        // off the tangent plane are left out so that light does not leak through thin walls.
+        if (photons.empty())
+            return color(0,0,0);
+
+        std::int64_t base[3];
+        for (int axis = 0; axis < 3; axis++) {
+            // The lower of the two cells along each axis that the disc can reach.
+            auto c = std::floor(p[axis] / cell_size);
+            base[axis] = std::int64_t(c) - ((p[axis] / cell_size - c < 0.5) ? 1 : 0);
+        }
+
+        std::uint32_t visited[8];
+        int visited_count = 0;
+        color sum(0,0,0);
+        auto radius_squared = radius * radius;
+
+        for (int corner = 0; corner < 8; corner++) {
+            auto b = bucket(base[0] + (corner & 1), base[1] + ((corner >> 1) & 1),
+                            base[2] + ((corner >> 2) & 1));
+
+            // Neighbouring cells may share a bucket; count its photons once.
+            bool seen = false;
+            for (int k = 0; k < visited_count; k++)
+                seen = seen || visited[k] == b;
+            if (seen)
+                continue;
+            visited[visited_count++] = b;
+
+            for (auto i = bucket_start[b]; i < bucket_start[b + 1]; i++) {
+                const auto& ph = photons[i];
+                auto offset = ph.p - p;
+                if (offset.length_squared() > radius_squared)
+                    continue;
+                if (std::fabs(dot(offset, normal)) > 0.1 * radius || dot(ph.direction, normal) >= 0)
+                    continue;
+                sum += ph.power;
+            }
+        }
+
+        return sum / (pi * radius_squared);
+    }
+
+  private:
+    std::vector<photon> photons;
+    std::vector<std::uint32_t> bucket_start;  // Photons of bucket b: [start[b], start[b+1])
+    std::size_t mask;
+    double radius;
+    double cell_size;
+
+    std::int64_t cell(double x) const { return std::int64_t(std::floor(x / cell_size)); }
+
+    std::uint32_t bucket(std::int64_t x, std::int64_t y, std::int64_t z) const {
+        // Spatial hash of Teschner et al. (2003).
+        auto h = std::uint64_t(x) * 73856093u ^ std::uint64_t(y) * 19349663u
+               ^ std::uint64_t(z) * 83492791u;
+        return std::uint32_t(h & mask);
+    }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef PSS_SAMPLER_H
+#define PSS_SAMPLER_H
+
+#include "rtweekend.h"
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+class pss_sampler : public sample_source {
+  // Point of primary sample space for Metropolis light transport (Kelemen et al. 2002): the
+  // vector of uniform numbers a path consumes, in the order it consumes them. Each iteration
+  // proposes a mutation of the whole vector, either a large step (fresh numbers everywhere) or
+  // a small one (every number perturbed by a narrow normal, wrapping around [0,1)). Numbers are
+  // mutated lazily, when the path asks for them, so paths of any length cost only what they
+  // use; those changed by a rejected proposal are restored. As in pbrt's MLTSampler.
+  public:
+    pss_sampler(std::uint64_t seed, double sigma, double large_step_probability)
+      : rng(seed), sigma(sigma), large_step_probability(large_step_probability) {}
+
+    void start_iteration() {
+        // Begins a proposal; the first path evaluated after construction is a large step.
+        current_iteration++;
+        large_step = uniform() < large_step_probability;
+        index = 0;
+    }
+
+    double next() override {
+        ensure_ready(index);
+        return samples[index++].value;
+    }
+
+    void accept() {
+        if (large_step)
+            last_large_step_iteration = current_iteration;
+    }
+
+    void reject() {
+        for (auto& x : samples) {
+            if (x.last_modification == current_iteration)
+                x.restore();
+        }
+        current_iteration--;
+    }
+
+    bool is_large_step() const { return large_step; }
+
+  private:
+    struct primary_sample {
+        double value = 0;
+        std::int64_t last_modification = 0;
+        double value_backup = 0;
+        std::int64_t modification_backup = 0;
+
+        void save() {
+            value_backup = value;
+            modification_backup = last_modification;
+        }
+
+        void restore() {
+            value = value_backup;
+            last_modification = modification_backup;
+        }
+    };
+
+    std::mt19937_64 rng;
+    double sigma;
+    double large_step_probability;
+    std::vector<primary_sample> samples;
+    std::int64_t current_iteration = 0;
+    std::int64_t last_large_step_iteration = 0;
+    bool large_step = true;
+    size_t index = 0;
+
+    double uniform() {
+        return (rng() >> 11) * 0x1.0p-53;
+    }
+
+    void ensure_ready(size_t i) {
+        // A number no earlier path consumed starts out uniform, as a large step would leave it;
+        // were it zero instead, small steps would keep rejection loops rejecting forever.
+        while (i >= samples.size()) {
+            samples.emplace_back();
+            samples.back().value = uniform();
+            samples.back().last_modification = current_iteration - 1;
+        }
+        auto& x = samples[i];
+
+        // A number untouched since before the last accepted large step was replaced by it.
+        if (x.last_modification < last_large_step_iteration) {
+            x.value = uniform();
+            x.last_modification = last_large_step_iteration;
+        }
+
+        x.save();
+        if (large_step) {
+            x.value = uniform();
+        } else {
+            // The small steps it missed, folded into one of the same total variance.
+            auto steps = current_iteration - x.last_modification;
+            std::normal_distribution<double> normal(0.0, sigma * std::sqrt(double(steps)));
+            x.value += normal(rng);
+            x.value -= std::floor(x.value);
+            if (x.value >= 1)  // -epsilon wraps to 1 after rounding
+                x.value = 0;
+        }
+        x.last_modification = current_iteration;
+    }
+};
+
+#endif
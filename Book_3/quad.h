@@ -3,6 +3,8 @@
 
 #include "hittable.h"
 #include "hittable_list.h"
+#include <algorithm>
+#include <cmath>
 
 class quad : public hittable {
   public:
@@ -14,7 +16,10 @@ class quad : public hittable {
         D = dot(normal, Q);
         w = n / dot(n,n);
 
-        area = n.length();
+        quad_area = n.length();
+
+        // Rectangles (u perpendicular to v) are sampled by solid angle.
+        rectangular = std::fabs(dot(u, v)) < 1e-9 * u.length() * v.length();
 
         set_bounding_box();
     }
@@ -29,6 +34,10 @@ class quad : public hittable {
     aabb bounding_box() const override { return bbox; }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
         auto denom = dot(normal, r.direction());
 
         // No hit if the ray is parallel to the plane.
@@ -49,14 +58,17 @@ class quad : public hittable {
         if (!is_interior(alpha, beta, rec))
             return false;
 
-        // Ray hits the 2D shape; set the rest of the hit record and return true.
+        // Ray hits the 2D shape; the rest of the hit record is left to set_surface().
         rec.t = t;
-        rec.p = intersection;
-        rec.mat = mat;
-        rec.set_face_normal(r, normal);
+        rec.object = this;
 
         return true;
-    
+    }
+
+    void set_surface(const ray& r, hit_record& rec) const override {
+        rec.p = r.at(rec.t);
+        rec.mat = mat.get();
+        rec.set_face_normal(r, normal);
     }
 
     virtual bool is_interior(double a, double b, hit_record& rec) const {
@@ -73,22 +85,178 @@ class quad : public hittable {
     }
 
     double pdf_value(const point3& origin, const vec3& direction) const override {
-        hit_record rec;
-        if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+        // Evaluated in closed form: zero unless the direction crosses the quad, else uniform
+        // over the solid angle of a rectangle, or the area density of other parallelograms.
+        auto denom = dot(normal, direction);
+        if (std::fabs(denom) < 1e-8)
             return 0;
 
-        auto distance_squared = rec.t * rec.t * direction.length_squared();
-        auto cosine = std::fabs(dot(direction, rec.normal) / direction.length());
+        auto t = (D - dot(normal, origin)) / denom;
+        if (t <= 0.001)
+            return 0;
+
+        vec3 planar_hitpt_vector = origin + t*direction - Q;
+        auto alpha = dot(w, cross(planar_hitpt_vector, v));
+        auto beta = dot(w, cross(u, planar_hitpt_vector));
+        if (alpha < 0 || alpha > 1 || beta < 0 || beta > 1)
+            return 0;
+
+        auto omega = sampled_solid_angle(origin);
+        if (omega > 0)
+            return 1 / omega;
+
+        auto distance_squared = t * t * direction.length_squared();
+        auto cosine = std::fabs(denom / direction.length());
 
-        return distance_squared / (cosine * area);
+        return distance_squared / (cosine * quad_area);
+    }
+
+    double area() const override { return quad_area; }
+
+    vec3 emission_axis() const override { return normal; }
+
+    bool sample_surface(surface_sample& s) const override {
+        s.u = random_double();
+        s.v = random_double();
+        s.p = Q + (s.u * u) + (s.v * v);
+        s.normal = normal;
+        s.mat = mat.get();
+        s.pdf = 1 / quad_area;
+        return true;
+    }
+
+    double surface_pdf(const point3& p) const override {
+        vec3 planar_hitpt_vector = p - Q;
+        if (std::fabs(dot(normal, planar_hitpt_vector)) > 1e-6 * std::sqrt(quad_area))
+            return 0;
+
+        auto alpha = dot(w, cross(planar_hitpt_vector, v));
+        auto beta = dot(w, cross(u, planar_hitpt_vector));
+        if (alpha < 0 || alpha > 1 || beta < 0 || beta > 1)
+            return 0;
+        return 1 / quad_area;
     }
 
     vec3 random(const point3& origin) const override {
+        spherical_rectangle rect;
+        if (solid_angle_sampling(origin, rect))
+            return rect.sample(random_double(), random_double());
+
         auto p = Q + (random_double() * u) + (random_double() * v);
         return p - origin;
     }
 
   private:
+    struct spherical_rectangle {
+        // The rectangle as seen from the origin, in a frame (ex, ey, ez) aligned with its sides
+        // and placed so it lies at z0 < 0: spans [x0,x1] x [y0,y1] (Urena et al. 2013).
+        vec3 ex, ey, ez;
+        double x0, x1, y0, y1, z0;
+        double b0, b1, k;
+        double solid_angle;
+
+        vec3 sample(double s, double t) const {
+            // Maps (s, t) in [0,1)^2 uniformly onto the solid angle; returns the direction to
+            // the point on the rectangle.
+            auto au = s * solid_angle + k;
+            auto fu = (std::cos(au) * b0 - b1) / std::sin(au);
+            auto cu = std::clamp((fu > 0 ? 1 : -1) / std::sqrt(fu*fu + b0*b0), -1.0, 1.0);
+            auto xu = std::clamp(-(cu * z0) / std::sqrt(std::fmax(1e-12, 1 - cu*cu)), x0, x1);
+
+            auto d = std::sqrt(xu*xu + z0*z0);
+            auto h0 = y0 / std::sqrt(d*d + y0*y0);
+            auto h1 = y1 / std::sqrt(d*d + y1*y1);
+            auto hv = h0 + t * (h1 - h0);
+            auto yv = (hv*hv < 1 - 1e-6) ? (hv * d) / std::sqrt(1 - hv*hv) : y1;
+
+            return xu*ex + yv*ey + z0*ez;
+        }
+    };
+
+    bool solid_angle_sampling(const point3& origin, spherical_rectangle& rect) const {
+        // Sets up the spherical rectangle the quad subtends from the origin. Returns false
+        // where sampled_solid_angle() chooses area sampling instead.
+        if (sampled_solid_angle(origin) <= 0)
+            return false;
+
+        auto u_length = u.length();
+        auto v_length = v.length();
+        rect.ex = u / u_length;
+        rect.ey = v / v_length;
+        rect.ez = cross(rect.ex, rect.ey);
+
+        auto d = Q - origin;
+        rect.x0 = dot(d, rect.ex);
+        rect.y0 = dot(d, rect.ey);
+        rect.z0 = dot(d, rect.ez);
+        if (rect.z0 > 0) {
+            rect.z0 = -rect.z0;
+            rect.ez = -rect.ez;
+        }
+        rect.x1 = rect.x0 + u_length;
+        rect.y1 = rect.y0 + v_length;
+
+        // Normals of the planes through the origin and each edge, and the interior angles.
+        vec3 v00(rect.x0, rect.y0, rect.z0), v01(rect.x0, rect.y1, rect.z0);
+        vec3 v10(rect.x1, rect.y0, rect.z0), v11(rect.x1, rect.y1, rect.z0);
+        auto n0 = unit_vector(cross(v00, v10));
+        auto n1 = unit_vector(cross(v10, v11));
+        auto n2 = unit_vector(cross(v11, v01));
+        auto n3 = unit_vector(cross(v01, v00));
+
+        auto g0 = std::acos(std::clamp(-dot(n0, n1), -1.0, 1.0));
+        auto g1 = std::acos(std::clamp(-dot(n1, n2), -1.0, 1.0));
+        auto g2 = std::acos(std::clamp(-dot(n2, n3), -1.0, 1.0));
+        auto g3 = std::acos(std::clamp(-dot(n3, n0), -1.0, 1.0));
+
+        rect.b0 = n0.z();
+        rect.b1 = n2.z();
+        rect.k = 2*pi - g2 - g3;
+        rect.solid_angle = g0 + g1 - rect.k;
+
+        return true;
+    }
+
+    double sampled_solid_angle(const point3& origin) const {
+        // The solid angle the quad is sampled over from the origin, or 0 where it is sampled by
+        // area: parallelograms, solid angles too small to be worth it, and origins (nearly) in
+        // its plane, where the spherical sampling loses precision. pdf_value() and random()
+        // both decide here, so they always agree on the strategy.
+        if (!rectangular || !looks_large(origin))
+            return 0;
+        if (std::fabs(dot(Q - origin, normal)) < 1e-9)
+            return 0;
+
+        auto omega = solid_angle(origin);
+        return (omega > 3e-4 && omega < 6.22) ? omega : 0;
+    }
+
+    bool looks_large(const point3& origin) const {
+        // Cheap estimate of the solid angle, seen from the center. Below about 0.1 sr area
+        // sampling is already close to uniform in solid angle, and cheaper.
+        auto to_center = Q + 0.5*(u + v) - origin;
+        auto distance_squared = to_center.length_squared();
+        auto cosine = std::fabs(dot(normal, to_center));
+        return quad_area * cosine > 0.1 * distance_squared * std::sqrt(distance_squared);
+    }
+
+    double solid_angle(const point3& origin) const {
+        // Solid angle of the quad from the origin, as that of its two triangles (Van Oosterom &
+        // Strackee), which is cheaper than the full spherical rectangle setup.
+        auto a = Q - origin, b = a + u, c = a + u + v, d = a + v;
+        auto la = a.length(), lb = b.length(), lc = c.length(), ld = d.length();
+
+        auto triangle = [](const vec3& p, const vec3& q, const vec3& r,
+                           double lp, double lq, double lr) {
+            auto numerator = std::fabs(dot(p, cross(q, r)));
+            auto denominator = lp*lq*lr + dot(p, q)*lr + dot(p, r)*lq + dot(q, r)*lp;
+            return 2 * std::atan2(numerator, denominator);
+        };
+
+        auto omega = triangle(a, b, c, la, lb, lc) + triangle(a, c, d, la, lc, ld);
+        return (omega < 0) ? omega + 4*pi : omega;
+    }
+
     point3 Q;
     vec3 u, v;
     vec3 w;
@@ -96,30 +264,8 @@ class quad : public hittable {
     aabb bbox;
     vec3 normal;
     double D;
-    double area;
+    double quad_area;
+    bool rectangular;
 };
 
-inline std::shared_ptr<hittable_list> box(const point3& a, const point3& b, std::shared_ptr<material> mat)
-{
-    // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
-
-    auto sides = std::make_shared<hittable_list>();
-
-    // Construct the two opposite vertices with the minimum and maximum coordinates.
-    auto min = point3(std::fmin(a.x(),b.x()), std::fmin(a.y(),b.y()), std::fmin(a.z(),b.z()));
-    auto max = point3(std::fmax(a.x(),b.x()), std::fmax(a.y(),b.y()), std::fmax(a.z(),b.z()));
-
-    auto dx = vec3(max.x() - min.x(), 0, 0);
-    auto dy = vec3(0, max.y() - min.y(), 0);
-    auto dz = vec3(0, 0, max.z() - min.z());
-
-    sides->add(std::make_shared<quad>(point3(min.x(), min.y(), max.z()),  dx,  dy, mat)); // front
-    sides->add(std::make_shared<quad>(point3(max.x(), min.y(), max.z()), -dz,  dy, mat)); // right
-    sides->add(std::make_shared<quad>(point3(max.x(), min.y(), min.z()), -dx,  dy, mat)); // back
-    sides->add(std::make_shared<quad>(point3(min.x(), min.y(), min.z()),  dz,  dy, mat)); // left
-    sides->add(std::make_shared<quad>(point3(min.x(), max.y(), max.z()),  dx, -dz, mat)); // top
-    sides->add(std::make_shared<quad>(point3(min.x(), min.y(), min.z()),  dx,  dz, mat)); // bottom
-
-    return sides;
-}
 #endif
\ No newline at end of file
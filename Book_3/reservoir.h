@@ -0,0 +1,52 @@
+#ifndef RESERVOIR_H
+#define RESERVOIR_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+
+
+struct light_sample {
+    // Point on an emitter reached by a light candidate, kept so that its emission and geometry
+    // can be evaluated again from another shading point.
+    point3 p;
+    vec3 normal;     // Outward normal at p
+    double u, v;
+    material* mat;   // Emissive material of the light
+};
+
+class reservoir {
+  // Weighted reservoir sampling over a stream of light samples: keeps a single sample, chosen
+  // with probability proportional to its weight, in constant memory. Reservoirs merge by
+  // feeding one into the other with its kept sample standing for everything it has seen.
+  public:
+    light_sample sample;
+    double target = 0;       // Target function of the kept sample at the owner's shading point
+    double weight_sum = 0;   // Sum of the resampling weights of every candidate seen
+    double count = 0;        // Number of candidates seen (M)
+    double contribution_weight = 0;  // W, an estimate of 1/pdf of the kept sample
+
+    void update(const light_sample& candidate, double candidate_target, double weight,
+                double candidates = 1) {
+        // Adds `candidates` candidates of the given total weight, represented by `candidate`.
+        weight_sum += weight;
+        count += candidates;
+        if (weight > 0 && random_double() * weight_sum < weight) {
+            sample = candidate;
+            target = candidate_target;
+        }
+    }
+
+    void skip() {
+        // Adds a candidate that has no weight (e.g. a light sample that missed every emitter).
+        count += 1;
+    }
+
+    void finalize(double normalization) {
+        // Sets W once every candidate is in; `normalization` is the number of candidates whose
+        // source could have produced the kept sample (plain RIS: all of them, M).
+        contribution_weight = (target > 0 && normalization > 0)
+                            ? weight_sum / (normalization * target) : 0;
+    }
+};
+
+#endif
@@ -0,0 +1,281 @@
+#ifndef RESTIR_INTEGRATOR_H
+#define RESTIR_INTEGRATOR_H
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "path_tracer.h"
+#include "reservoir.h"
+#include "sampler.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+
+class restir_integrator {
+  // integrator_type::restir: direct light at the first non-specular vertex of each camera path
+  // is resampled from many light candidates and reused between neighbouring pixels, with one
+  // shadow ray; deeper vertices use nee_mis.
+  public:
+    restir_integrator(const camera& cam, const path_tracer& tracer) : cam(cam), tracer(tracer) {}
+
+    void render(
+        const hittable& world, const hittable& lights,
+        std::vector<std::vector<color>>& pixel_buffer
+    ) const {
+        // Renders in square tiles, one pixel sample at a time: every pixel of the tile first
+        // traces its path and fills a reservoir from cheap light candidates, then merges the
+        // reservoirs of a few similar neighbours in the tile and traces one shadow ray.
+        const int tile_size = 16;
+        int tiles_x = (cam.image_width + tile_size - 1) / tile_size;
+        int tiles_y = (cam.image_height + tile_size - 1) / tile_size;
+        std::atomic<int> tiles_left(tiles_x * tiles_y);
+        std::atomic<bool> missing_material(false);
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int tile = 0; tile < tiles_x * tiles_y; tile++) {
+            int x0 = (tile % tiles_x) * tile_size, y0 = (tile / tiles_x) * tile_size;
+            int width = std::min(tile_size, cam.image_width - x0);
+            int height = std::min(tile_size, cam.image_height - y0);
+
+            std::vector<restir_vertex> vertices(width * height);
+            std::vector<color> sums(width * height, color(0,0,0));
+            pixel_sampler numbers(cam.sampler, cam.sqrt_spp * cam.sqrt_spp);
+
+            for (int s_j = 0; s_j < cam.sqrt_spp; s_j++) {
+                for (int s_i = 0; s_i < cam.sqrt_spp; s_i++) {
+                    for (int y = 0; y < height; y++) {
+                        for (int x = 0; x < width; x++) {
+                            sample_source_scope scope(cam.start_camera_sample(
+                                numbers, x0 + x, y0 + y, s_j*cam.sqrt_spp + s_i));
+                            ray r = cam.get_ray(x0 + x, y0 + y, s_i, s_j);
+                            vertices[y*width + x] = restir_path(r, world, lights, missing_material);
+                        }
+                    }
+
+                    for (int y = 0; y < height; y++) {
+                        for (int x = 0; x < width; x++) {
+                            const auto& vertex = vertices[y*width + x];
+                            sums[y*width + x] += vertex.radiance;
+                            if (vertex.valid) {
+                                sums[y*width + x] += vertex.throughput
+                                    * restir_direct(vertices, width, height, x, y, world);
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                    pixel_buffer[y0 + y][x0 + x] = cam.pixel_samples_scale * sums[y*width + x];
+
+            // Only one thread should update the progress bar
+            #pragma omp critical
+            std::clog << "\rTiles remaining: " << --tiles_left << ' ' << std::flush;
+        }
+
+        if (missing_material) {
+            std::cerr << "WARNING: restir light samples reached lights without a material; "
+                         "give the lights their emissive material.\n";
+        }
+    }
+
+  private:
+    const camera& cam;
+    const path_tracer& tracer;
+
+    struct restir_vertex {
+        // First non-specular vertex of a camera path, with what the path gathered elsewhere.
+        bool valid = false;
+        ray r_in;
+        hit_record rec;
+        color attenuation;   // Material attenuation at the vertex
+        color throughput;    // Product of the specular attenuations in front of the vertex
+        color radiance;      // Everything the path gathered except the vertex's direct light
+        reservoir res;
+    };
+
+
+    restir_vertex restir_path(
+        const ray& r, const hittable& world, const hittable& lights,
+        std::atomic<bool>& missing_material
+    ) const {
+        // Follows a camera ray through specular bounces to its first non-specular vertex, fills
+        // the vertex's reservoir with light candidates, and continues the path from there.
+        restir_vertex vertex;
+        vertex.throughput = color(1,1,1);
+        vertex.radiance = color(0,0,0);
+
+        ray current = r;
+        for (int depth = cam.max_depth; depth > 0; depth--) {
+            hit_record rec;
+            if (!world.hit(current, interval(0.001, infinity), rec)) {
+                vertex.radiance += vertex.throughput * tracer.escaped_radiance(current);
+                return vertex;
+            }
+
+            // Nothing sampled the lights before this vertex, so its emission counts in full.
+            vertex.radiance += vertex.throughput * emitted(*rec.mat, current, rec);
+
+            scatter_record srec;
+            if (!scatter(*rec.mat, current, rec, srec))
+                return vertex;
+
+            if (srec.skip_pdf) {
+                vertex.throughput = vertex.throughput * srec.attenuation;
+                current = srec.skip_pdf_ray;
+                continue;
+            }
+
+            vertex.valid = true;
+            vertex.r_in = current;
+            vertex.rec = rec;
+            vertex.attenuation = srec.attenuation;
+
+            bool gathers_caustics = tracer.caustics && tracer.is_diffuse(*rec.mat);
+            if (gathers_caustics) {
+                vertex.radiance += vertex.throughput * srec.attenuation
+                                 * tracer.caustics->estimate(rec.p, rec.normal) / pi;
+            }
+
+            // Candidates only intersect the lights, not the world. Each is weighted by the
+            // unshadowed contribution over its density on the light's surface.
+            for (int c = 0; c < cam.restir_candidates; c++) {
+                auto direction = lights.random(rec.p);
+                auto light_pdf = lights.pdf_value(rec.p, direction);
+
+                hit_record light_rec;
+                if (light_pdf <= 0
+                    || !lights.hit(ray(rec.p, direction, current.time()),
+                                   interval(0.001, infinity), light_rec)) {
+                    vertex.res.skip();
+                    continue;
+                }
+                if (!light_rec.mat) {
+                    missing_material = true;
+                    vertex.res.skip();
+                    continue;
+                }
+
+                light_sample y { light_rec.p,
+                                 light_rec.front_face ? light_rec.normal : -light_rec.normal,
+                                 light_rec.u, light_rec.v, light_rec.mat };
+                auto g = geometry_term(rec.p, y);
+                auto target = g > 0 ? light_sample_target(vertex, y) : 0;
+                vertex.res.update(y, target, g > 0 ? target / (light_pdf * g) : 0);
+            }
+            vertex.res.finalize(vertex.res.count);
+
+            // Material sample for the indirect light; emitters the candidates could reach are
+            // already part of the direct light.
+            ray scattered(rec.p, srec.pdf_ptr->generate(), current.time());
+            auto pdf_value = srec.pdf_ptr->value(scattered.direction());
+            if (pdf_value > 0) {
+                auto scatter_pdf = scattering_pdf(*rec.mat, current, rec, scattered);
+                if (scatter_pdf > 0) {
+                    color sample_color =
+                        tracer.ray_color_mis(scattered, depth-1, world, lights, infinity, true,
+                                      gathers_caustics);
+                    vertex.radiance += vertex.throughput
+                        * (srec.attenuation * scatter_pdf * sample_color) / pdf_value;
+                }
+            }
+            return vertex;
+        }
+
+        return vertex;
+    }
+
+    color restir_direct(
+        const std::vector<restir_vertex>& vertices, int width, int height, int x, int y,
+        const hittable& world
+    ) const {
+        // Spatial reuse: merges the reservoir of pixel (x, y) with those of a few nearby pixels
+        // of the tile whose vertex looks alike, then shades the kept sample with one shadow ray.
+        const int radius = 6;
+        const auto& self = vertices[y*width + x];
+
+        reservoir merged;
+        merged.update(self.res.sample, self.res.target, self.res.weight_sum, self.res.count);
+
+        const restir_vertex* used[16];
+        int used_count = 0;
+        used[used_count++] = &self;
+
+        auto depth = (self.rec.p - cam.center).length();
+        for (int n = 0; n < cam.restir_neighbors && used_count < 16; n++) {
+            int nx = std::clamp(x + random_int(-radius, radius), 0, width - 1);
+            int ny = std::clamp(y + random_int(-radius, radius), 0, height - 1);
+            const auto& other = vertices[ny*width + nx];
+            if (&other == &self || !other.valid || other.res.contribution_weight <= 0)
+                continue;
+            if (dot(other.rec.normal, self.rec.normal) < 0.9
+                || std::fabs((other.rec.p - cam.center).length() - depth) > 0.1 * depth)
+                continue;
+
+            auto target = light_sample_target(self, other.res.sample);
+            merged.update(other.res.sample, target,
+                          target * other.res.contribution_weight * other.res.count,
+                          other.res.count);
+            used[used_count++] = &other;
+        }
+
+        if (merged.target <= 0)
+            return color(0,0,0);
+
+        // Count only the candidates whose own pixel could have produced the kept sample; this
+        // keeps the merge unbiased where the neighbours' target functions differ from ours.
+        double normalization = 0;
+        for (int i = 0; i < used_count; i++) {
+            if (used[i] == &self || light_sample_target(*used[i], merged.sample) > 0)
+                normalization += used[i]->res.count;
+        }
+        merged.finalize(normalization);
+
+        // One shadow ray to the kept point; the light itself sits at t = 1.
+        ray shadow(self.rec.p, merged.sample.p - self.rec.p, self.r_in.time());
+        hit_record blocker;
+        if (world.hit(shadow, interval(0.001, 0.999), blocker))
+            return color(0,0,0);
+
+        return light_sample_contribution(self, merged.sample) * merged.contribution_weight;
+    }
+
+    color light_sample_contribution(const restir_vertex& vertex, const light_sample& y) const {
+        // Unshadowed light that the sample sends out of the vertex, per unit area of the light.
+        auto g = geometry_term(vertex.rec.p, y);
+        if (g <= 0 || !y.mat)
+            return color(0,0,0);
+
+        ray to_light(vertex.rec.p, y.p - vertex.rec.p, vertex.r_in.time());
+        auto scatter_value = scattering_pdf(*vertex.rec.mat, vertex.r_in, vertex.rec, to_light);
+        if (scatter_value <= 0)
+            return color(0,0,0);
+
+        hit_record light_rec;
+        light_rec.p = y.p;
+        light_rec.t = 1;
+        light_rec.u = y.u;
+        light_rec.v = y.v;
+        light_rec.mat = y.mat;
+        light_rec.set_face_normal(to_light, y.normal);
+
+        return vertex.attenuation * scatter_value * emitted(*y.mat, to_light, light_rec) * g;
+    }
+
+    double light_sample_target(const restir_vertex& vertex, const light_sample& y) const {
+        // Target function of the resampling: the luminance of the unshadowed contribution.
+        return light_list::luminance(light_sample_contribution(vertex, y));
+    }
+
+    static double geometry_term(const point3& p, const light_sample& y) {
+        // Converts a density over the light's area into one over directions at p.
+        auto to_p = p - y.p;
+        auto distance_squared = to_p.length_squared();
+        if (distance_squared <= 0)
+            return 0;
+        return std::fabs(dot(y.normal, to_p)) / (distance_squared * std::sqrt(distance_squared));
+    }
+};
+
+#endif
@@ -21,7 +21,42 @@ inline double degrees_to_radians(double degrees) {
 // Utility Functions
 
 
+class sample_source {
+  // Supplier of the numbers random_double() returns on a thread while it is installed there
+  // with sample_source_scope, for renderers that need to control the numbers a path consumes.
+  public:
+    virtual ~sample_source() = default;
+
+    virtual double next() = 0;  // A number in [0,1)
+};
+
+inline sample_source*& thread_sample_source() {
+    static thread_local sample_source* source = nullptr;
+    return source;
+}
+
+struct sample_source_scope {
+    // Installs a sample_source on the calling thread for the lifetime of the scope.
+    sample_source* previous;
+
+    sample_source_scope(sample_source& source) : previous(thread_sample_source()) {
+        thread_sample_source() = &source;
+    }
+    explicit sample_source_scope(sample_source* source) : previous(thread_sample_source()) {
+        // A null source leaves the one in place.
+        if (source)
+            thread_sample_source() = source;
+    }
+    ~sample_source_scope() { thread_sample_source() = previous; }
+
+    sample_source_scope(const sample_source_scope&) = delete;
+    sample_source_scope& operator=(const sample_source_scope&) = delete;
+};
+
 inline double random_double() {
+    if (auto source = thread_sample_source())
+        return source->next();
+
     static std::uniform_real_distribution<double> distribution(0.0, 1.0);
     static std::mt19937 generator;
     return distribution(generator);
@@ -0,0 +1,191 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rtweekend.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+// Where the numbers of a camera sample come from.
+enum class sampler_type {
+    independent,  // The thread's pseudo-random generator
+    sobol,        // Owen-scrambled Sobol points, padded from independently scrambled 2D pairs
+    halton,       // Scrambled Halton points, one prime base per dimension
+};
+
+class pixel_sampler : public sample_source {
+  // Low-discrepancy numbers for the paths of a pixel. start_sample() begins camera sample
+  // `index` of pixel (x, y); after it, the n-th random_double() of the path (while installed with
+  // sample_source_scope) returns dimension n of point `index` of a point set private to the
+  // pixel, so that the pixel offset, lens, light choice and material samples of successive paths
+  // fill their domains evenly. Scrambling seeded by the pixel keeps the error of neighbouring
+  // pixels uncorrelated.
+  //
+  // sobol: dimensions are taken in pairs, each the first two dimensions of Sobol's sequence
+  // (well stratified in 2D at every power of two) with its own Owen scrambling and its own
+  // shuffle of the sample indices, so that pairs do not correlate with each other (pbrt's
+  // padded Sobol sampler). Works for any number of dimensions.
+  // halton: dimension d is the radical inverse in the d-th prime base with scrambled digits;
+  // past the last prime kept, numbers are hashed from the sample and dimension instead.
+  public:
+    pixel_sampler(sampler_type type, int samples_per_pixel, std::uint64_t seed = 0)
+      : type(type), samples_per_pixel(std::uint32_t(std::max(1, samples_per_pixel))), seed(seed)
+    {}
+
+    void start_sample(int x, int y, int index) {
+        pixel_hash = mix_bits(seed ^ mix_bits((std::uint64_t(std::uint32_t(x)) << 32)
+                                              | std::uint32_t(y)));
+        sample_index = std::uint32_t(index);
+        dimension = 0;
+    }
+
+    double next() override {
+        auto d = dimension++;
+        if (type == sampler_type::sobol)
+            return sobol(d);
+        if (type == sampler_type::halton && d < primes().size())
+            return halton(d);
+        return hashed(d);
+    }
+
+  private:
+    sampler_type type;
+    std::uint32_t samples_per_pixel;
+    std::uint64_t seed;
+    std::uint64_t pixel_hash = 0;
+    std::uint32_t sample_index = 0;
+    std::uint32_t dimension = 0;
+
+    double sobol(std::uint32_t d) const {
+        auto pair_hash = mix_bits(pixel_hash ^ (std::uint64_t(d / 2) + 1) * 0x9e3779b97f4a7c15ull);
+        auto index = permutation_element(sample_index % samples_per_pixel, samples_per_pixel,
+                                         std::uint32_t(pair_hash))
+                   + sample_index / samples_per_pixel * samples_per_pixel;
+        auto bits = (d % 2 == 0) ? reverse_bits(index) : sobol_second_dimension(index);
+        return to_unit(owen_scramble(bits, std::uint32_t(pair_hash >> 32)));
+    }
+
+    double halton(std::uint32_t d) const {
+        // Radical inverse whose every digit is shifted (mod base) by a hash of the digits below
+        // it: nested random digit shifts, a cheap form of Owen scrambling. Digits go down to the
+        // 32-bit resolution of the Sobol points.
+        auto base = primes()[d];
+        auto hash = mix_bits(pixel_hash ^ (std::uint64_t(d) + 1) * 0x9e3779b97f4a7c15ull);
+        if (base == 2)  // Binary digits scramble all at once, as in sobol()
+            return to_unit(owen_scramble(reverse_bits(sample_index), std::uint32_t(hash)));
+        auto digits = int(std::ceil(32 * std::log(2.0) / std::log(double(base))));
+
+        std::uint64_t a = sample_index;
+        std::uint64_t reversed = 0;
+        double inverse_base_power = 1;
+        for (int k = 0; k < digits; k++) {
+            auto digit = (a + mix_bits(hash ^ reversed)) % base;
+            reversed = reversed * base + digit;
+            inverse_base_power /= base;
+            a /= base;
+        }
+        return std::fmin(reversed * inverse_base_power, 1 - 0x1.0p-53);
+    }
+
+    double hashed(std::uint32_t d) const {
+        auto h = mix_bits(pixel_hash ^ mix_bits((std::uint64_t(d) << 32) | sample_index));
+        return (h >> 11) * 0x1.0p-53;
+    }
+
+    static const std::vector<std::uint32_t>& primes() {
+        // The first 64 primes: higher bases fill the square too slowly to beat random numbers.
+        static const std::vector<std::uint32_t> table = [] {
+            std::vector<std::uint32_t> found;
+            for (std::uint32_t n = 2; found.size() < 64; n++) {
+                bool prime = true;
+                for (auto p : found)
+                    prime = prime && n % p != 0;
+                if (prime)
+                    found.push_back(n);
+            }
+            return found;
+        }();
+        return table;
+    }
+
+    static std::uint32_t sobol_second_dimension(std::uint32_t index) {
+        // Sobol's second dimension, generated by the direction numbers v_k = v_{k-1} ^ v_{k-1}/2,
+        // already bit-reversed (the most significant bit is the first binary digit).
+        std::uint32_t result = 0;
+        for (std::uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+            if (index & 1)
+                result ^= v;
+        }
+        return result;
+    }
+
+    static std::uint32_t owen_scramble(std::uint32_t v, std::uint32_t seed) {
+        // Hash-based nested uniform scrambling (Laine & Karras 2011, as refined in pbrt): each
+        // bit is flipped by a hash of the bits above it.
+        v = reverse_bits(v);
+        v ^= v * 0x3d20adea;
+        v += seed;
+        v *= (seed >> 16) | 1;
+        v ^= v * 0x05526c56;
+        v ^= v * 0x53a22864;
+        return reverse_bits(v);
+    }
+
+    static std::uint32_t permutation_element(std::uint32_t i, std::uint32_t n, std::uint32_t p) {
+        // Element i of a pseudo-random permutation of [0, n) chosen by p (Kensler 2013): a hash
+        // that is a bijection on the bits under n's mask, repeated until it lands below n.
+        std::uint32_t w = n - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do {
+            i ^= p;
+            i *= 0xe170893d;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8;
+            i *= 0x0929eb3f;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1 | p >> 27;
+            i *= 0x6935fa69;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3df;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= n);
+        return (i + p) % n;
+    }
+
+    static std::uint32_t reverse_bits(std::uint32_t v) {
+        v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+        v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+        v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+        v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+        return (v >> 16) | (v << 16);
+    }
+
+    static std::uint64_t mix_bits(std::uint64_t v) {
+        // 64-bit finalizer of MurmurHash3.
+        v ^= v >> 33;
+        v *= 0xff51afd7ed558ccdull;
+        v ^= v >> 33;
+        v *= 0xc4ceb9fe1a85ec53ull;
+        v ^= v >> 33;
+        return v;
+    }
+
+    static double to_unit(std::uint32_t bits) {
+        return bits * 0x1.0p-32;
+    }
+};
+
+#endif
@@ -29,6 +29,10 @@ class sphere : public hittable {
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
         point3 current_center = center.at(r.time());
         vec3 oc = current_center - r.origin();
         auto a = r.direction().length_squared();
@@ -50,34 +54,66 @@ class sphere : public hittable {
         }
 
         rec.t = root;
+        rec.object = this;
+
+        return true;
+    }
+
+    void set_surface(const ray& r, hit_record& rec) const override {
         rec.p = r.at(rec.t);
-        vec3 outward_normal = (rec.p - current_center) / radius;
+        vec3 outward_normal = (rec.p - center.at(r.time())) / radius;
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u, rec.v);
-        rec.mat = mat;
-
-        return true;
-      }
+        rec.mat = mat.get();
+    }
       
       aabb bounding_box() const override { return bbox; }
 
       double pdf_value(const point3& origin, const vec3& direction) const override {
-        // This method only works for stationary spheres.
-
-        hit_record rec;
-        if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+        // This method only works for stationary spheres. Directions are sampled uniformly in
+        // the cone the sphere subtends, so the density follows from the angle to the center
+        // alone, without intersecting the sphere.
+        auto to_center = center.at(0) - origin;
+        auto dist_squared = to_center.length_squared();
+        if (dist_squared <= radius*radius)
+            return 1 / (4*pi);
+
+        auto sin2_theta_max = radius*radius/dist_squared;
+        auto cos_theta_max = std::sqrt(1 - sin2_theta_max);
+        auto cos_theta = dot(to_center, direction)
+                       / std::sqrt(dist_squared * direction.length_squared());
+        if (cos_theta < cos_theta_max)
             return 0;
 
-        auto dist_squared = (center.at(0) - origin).length_squared();
-        auto cos_theta_max = std::sqrt(1 - radius*radius/dist_squared);
-        auto solid_angle = 2*pi*(1-cos_theta_max);
+        return 1 / cone_solid_angle(sin2_theta_max);
+    }
+
+    double area() const override { return 4*pi*radius*radius; }
+
+    bool sample_surface(surface_sample& s) const override {
+        // Uniform over the surface at time 0, like pdf_value().
+        if (radius <= 0)
+            return false;
+        s.normal = random_unit_vector();
+        s.p = center.at(0) + radius * s.normal;
+        get_sphere_uv(s.normal, s.u, s.v);
+        s.mat = mat.get();
+        s.pdf = 1 / area();
+        return true;
+    }
 
-        return  1 / solid_angle;
+    double surface_pdf(const point3& p) const override {
+        if (radius <= 0 || std::fabs((p - center.at(0)).length() - radius) > 1e-6 * radius)
+            return 0;
+        return 1 / area();
     }
 
     vec3 random(const point3& origin) const override {
         vec3 direction = center.at(0) - origin;
         auto distance_squared = direction.length_squared();
+        if (distance_squared <= radius*radius)
+            return random_unit_vector();  // From inside, every direction reaches the sphere
+
         onb uvw(direction);
         return uvw.transform(random_to_sphere(radius, distance_squared));
     }
@@ -103,10 +139,16 @@ class sphere : public hittable {
         v = theta / pi;
     }
 
+    static double cone_solid_angle(double sin2_theta_max) {
+        // 2 pi (1 - cos theta_max), written to stay accurate for small, distant spheres.
+        return 2*pi * sin2_theta_max / (1 + std::sqrt(1 - sin2_theta_max));
+    }
+
     static vec3 random_to_sphere(double radius, double distance_squared) {
         auto r1 = random_double();
         auto r2 = random_double();
-        auto z = 1 + r2*(std::sqrt(1-radius*radius/distance_squared) - 1);
+        auto sin2_theta_max = radius*radius/distance_squared;
+        auto z = 1 - r2 * sin2_theta_max / (1 + std::sqrt(1 - sin2_theta_max));
 
         auto phi = 2*pi*r1;
         auto x = std::cos(phi) * std::sqrt(1-z*z);